@@ -69,7 +69,7 @@ vector<AudioFile *> *AudioFileSet::getFileVector()
 //  Search path and load all audio files into memory.  Convert to mono (L)
 //  if needed.
 //---------------------------------------------------------------------------
-int AudioFileSet::loadFileSet(string localPath)
+int AudioFileSet::loadFileSet(string localPath, unsigned int numLevels, int format)
 {
     // read through loop directory and attempt to load audio files into buffers
 
@@ -157,11 +157,11 @@ int AudioFileSet::loadFileSet(string localPath)
             unsigned long fullSize = sfinfo.frames * sfinfo.channels;
 
             fileSet->push_back(new AudioFile(theFileName, myPath, sfinfo.channels,
-                                             sfinfo.frames, sfinfo.samplerate,
-                                             new double[fullSize]));
+                                             sfinfo.frames, sfinfo.samplerate));
 
 
             // accumulate the samples
+            SAMPLE *wave = (SAMPLE *)fileSet->at(fileCounter)->wave;
             unsigned long counter = 0;
             bool empty = false;
             do {
@@ -172,7 +172,7 @@ int AudioFileSet::loadFileSet(string localPath)
                 for (int i = 0; i < buffSize; i++) {
                     if (counter < fullSize) {
                         // if ((i % sfinfo.channels) == 0){
-                        fileSet->at(fileCounter)->wave[counter] = stereoBuff[i] * globalAtten;
+                        wave[counter] = stereoBuff[i] * globalAtten;
                         counter++;
                     }
                 }
@@ -188,6 +188,12 @@ int AudioFileSet::loadFileSet(string localPath)
                 fileSet->at(fileCounter)->resampleTo(::samp_rate);
             }
 
+            // octave levels for the grains which play fast
+            fileSet->at(fileCounter)->buildLevels(numLevels);
+
+            // compact storage once all the processing is done
+            fileSet->at(fileCounter)->convertTo(format);
+
             cout << counter << endl;
             // increment the file counter
             fileCounter++;
@@ -208,16 +214,52 @@ int AudioFileSet::loadFileSet(string localPath)
     return 0;
 }
 
-void AudioFile::resampleTo(unsigned int newRate)
+unsigned int AudioFile::sampleBytes(int format)
+{
+    switch (format) {
+    case AUDIOFILE_FLOAT32:
+        return sizeof(float);
+    case AUDIOFILE_INT16:
+        return sizeof(int16_t);
+    default:
+        return sizeof(SAMPLE);
+    }
+}
+
+char *AudioFile::allocateWave(unsigned long numFrames, unsigned int numChan,
+                              int format, void **wavePtr)
 {
-    unsigned channels = this->channels;
+    unsigned long bytes = sampleBytes(format);
+    unsigned long guard = (unsigned long)AUDIOFILE_GUARD_FRAMES * numChan * bytes;
+    char *data = new char[numFrames * numChan * bytes + 2 * guard]();
+    *wavePtr = data + guard;
+    return data;
+}
 
-    unsigned oldFrames = frames;
-    unsigned oldRate = sampleRate;
-    SAMPLE *oldWave = wave;
+double AudioFile::sampleAt(unsigned long frame, unsigned int chan) const
+{
+    unsigned long i = frame * channels + chan;
+    switch (format) {
+    case AUDIOFILE_FLOAT32:
+        return ((const float *)wave)[i];
+    case AUDIOFILE_INT16:
+        return ((const int16_t *)wave)[i] * scale;
+    default:
+        return ((const SAMPLE *)wave)[i];
+    }
+}
 
-    unsigned newFrames = ceil((double)oldRate * newRate / oldRate);
-    SAMPLE *newWave = new SAMPLE[channels * newFrames];
+// resample an interleaved waveform into a new guard-padded allocation.
+// returns the allocation, the first frame in *outWave and the length in
+// *outFrames.
+static char *resampleWave(const SAMPLE *in, unsigned long inFrames,
+                          unsigned int channels, double inRate, double outRate,
+                          void **outWave, unsigned long *outFrames)
+{
+    unsigned long newFrames = ceil((double)inFrames * outRate / inRate);
+    void *newWave = NULL;
+    char *newData = AudioFile::allocateWave(newFrames, channels,
+                                            AUDIOFILE_FLOAT64, &newWave);
 
     soxr_io_spec_t io_spec = soxr_io_spec(MY_RESAMPLER_FORMAT_I, MY_RESAMPLER_FORMAT_I);
     soxr_quality_spec_t quality_spec = soxr_quality_spec(SOXR_VHQ, 0);
@@ -225,15 +267,166 @@ void AudioFile::resampleTo(unsigned int newRate)
 
     size_t idone = 0;
     size_t odone = 0;
-    soxr_error_t err = soxr_oneshot(oldRate, newRate, channels, oldWave,
-                                    oldFrames, &idone, newWave, newFrames, &odone,
+    soxr_error_t err = soxr_oneshot(inRate, outRate, channels, in, inFrames,
+                                    &idone, newWave, newFrames, &odone,
                                     &io_spec, &quality_spec, &runtime_spec);
-    if (err)
+    if (err) {
+        delete[] newData;
         throw std::runtime_error("could not resample: libsoxr error");
-    newFrames = odone;
+    }
 
-    delete[] wave;
+    *outWave = newWave;
+    *outFrames = odone;
+    return newData;
+}
+
+void AudioFile::resampleTo(unsigned int newRate)
+{
+    // the levels are made from the waveform, drop them
+    freeLevels();
+
+    void *newWave = NULL;
+    unsigned long newFrames = 0;
+    char *newData = resampleWave((const SAMPLE *)wave, frames, channels,
+                                 sampleRate, newRate, &newWave, &newFrames);
+
+    delete[] waveData;
+    waveData = newData;
     wave = newWave;
     frames = newFrames;
     sampleRate = newRate;
+
+    levelWave[0] = wave;
+    levelFrames[0] = frames;
+}
+
+void AudioFile::buildLevels(unsigned int maxLevels)
+{
+    freeLevels();
+
+    if (maxLevels > AUDIOFILE_MAX_LEVELS)
+        maxLevels = AUDIOFILE_MAX_LEVELS;
+
+    // halve each level into the next, the resampler takes care of the
+    // band limiting
+    while (numLevels < maxLevels &&
+           levelFrames[numLevels - 1] / 2 >= AUDIOFILE_MIN_LEVEL_FRAMES) {
+        unsigned int k = numLevels;
+        levelData[k] = resampleWave((const SAMPLE *)levelWave[k - 1],
+                                    levelFrames[k - 1], channels, 2.0, 1.0,
+                                    &levelWave[k], &levelFrames[k]);
+        numLevels++;
+    }
+
+    buildPeaks();
+}
+
+void AudioFile::freeLevels()
+{
+    freePeaks();
+    for (unsigned int k = 1; k < numLevels; k++)
+        delete[] levelData[k];
+    numLevels = 1;
+}
+
+void AudioFile::buildPeaks()
+{
+    freePeaks();
+
+    for (unsigned int k = 0; k < numLevels; k++) {
+        const SAMPLE *x = (const SAMPLE *)levelWave[k];
+        unsigned long blocks = (levelFrames[k] + AUDIOFILE_PEAK_BLOCK - 1) / AUDIOFILE_PEAK_BLOCK;
+        float *peaks = new float[blocks];
+        for (unsigned long b = 0; b < blocks; b++) {
+            unsigned long first = b * AUDIOFILE_PEAK_BLOCK * channels;
+            unsigned long last = (b + 1) * AUDIOFILE_PEAK_BLOCK * channels;
+            if (last > levelFrames[k] * channels)
+                last = levelFrames[k] * channels;
+            double peak = 0.0;
+            for (unsigned long i = first; i < last; i++)
+                peak = (fabs(x[i]) > peak) ? fabs(x[i]) : peak;
+            // round up, so that the float never makes a block quieter
+            float p = (float)peak;
+            peaks[b] = ((double)p < peak) ? nextafterf(p, 1.0f) : p;
+        }
+        levelPeaks[k] = peaks;
+    }
+}
+
+void AudioFile::freePeaks()
+{
+    for (unsigned int k = 0; k < AUDIOFILE_MAX_LEVELS; k++) {
+        delete[] levelPeaks[k];
+        levelPeaks[k] = NULL;
+    }
+}
+
+double AudioFile::spanPeak(unsigned int level, unsigned long first, unsigned long last) const
+{
+    const float *peaks = levelPeaks[level];
+    if (!peaks)
+        return HUGE_VAL;
+
+    unsigned long lastBlock = (levelFrames[level] - 1) / AUDIOFILE_PEAK_BLOCK;
+    unsigned long b0 = first / AUDIOFILE_PEAK_BLOCK;
+    unsigned long b1 = last / AUDIOFILE_PEAK_BLOCK;
+    if (b1 > lastBlock)
+        b1 = lastBlock;
+
+    double peak = 0.0;
+    for (unsigned long b = b0; b <= b1; b++)
+        peak = (peaks[b] > peak) ? peaks[b] : peak;
+    return peak;
+}
+
+void AudioFile::convertTo(int newFormat)
+{
+    if (format != AUDIOFILE_FLOAT64 || newFormat == format)
+        return;
+
+    // int16 steps are sized after the peak of all the levels
+    double newScale = 1.0;
+    if (newFormat == AUDIOFILE_INT16) {
+        double peak = 0.0;
+        for (unsigned int k = 0; k < numLevels; k++) {
+            const SAMPLE *x = (const SAMPLE *)levelWave[k];
+            unsigned long n = levelFrames[k] * channels;
+            for (unsigned long i = 0; i < n; i++)
+                peak = (fabs(x[i]) > peak) ? fabs(x[i]) : peak;
+        }
+        if (peak > 0.0)
+            newScale = peak / 32767.0;
+    }
+
+    for (unsigned int k = 0; k < numLevels; k++) {
+        const SAMPLE *x = (const SAMPLE *)levelWave[k];
+        unsigned long n = levelFrames[k] * channels;
+
+        void *newWave = NULL;
+        char *newData = allocateWave(levelFrames[k], channels, newFormat, &newWave);
+        if (newFormat == AUDIOFILE_FLOAT32) {
+            float *y = (float *)newWave;
+            for (unsigned long i = 0; i < n; i++)
+                y[i] = (float)x[i];
+        }
+        else {
+            int16_t *y = (int16_t *)newWave;
+            for (unsigned long i = 0; i < n; i++)
+                y[i] = (int16_t)lrint(x[i] / newScale);
+        }
+
+        levelWave[k] = newWave;
+        if (k == 0) {
+            delete[] waveData;
+            waveData = newData;
+            wave = newWave;
+        }
+        else {
+            delete[] levelData[k];
+            levelData[k] = newData;
+        }
+    }
+
+    format = newFormat;
+    scale = newScale;
 }
@@ -36,16 +36,38 @@
 #include "sndfile.h"
 #include "dirent.h"
 #include <iostream>
+#include <stdint.h>
 #include "theglobals.h"
 using namespace std;
 
 
+// silent frames kept on both sides of each waveform, so that the grain
+// kernels may interpolate across the bounds of a sound without any test
+// (enough for the widest interpolation, see GrainKernel.h)
+enum { AUDIOFILE_GUARD_FRAMES = 4 };
+
+// maximum number of octave levels of a sound (the full rate one included),
+// and the shortest length a level is built for
+enum { AUDIOFILE_MAX_LEVELS = 6, AUDIOFILE_MIN_LEVEL_FRAMES = 64 };
+
+// frames per block of the peak index
+enum { AUDIOFILE_PEAK_BLOCK = 256 };
+
+// storage formats of the waveforms in memory.  sounds are loaded, resampled
+// and decimated as float64, then converted once.
+enum {
+    AUDIOFILE_FLOAT64,
+    AUDIOFILE_FLOAT32,
+    AUDIOFILE_INT16,  // with a scale factor, so that the peak is full scale
+    AUDIOFILE_NUM_FORMATS
+};
+
 // basic encapsulation of an audio file
 struct AudioFile {
 
-    // constructor
+    // constructor (allocates a silent float64 waveform of the given size)
     AudioFile(string myName, string thePath, unsigned int numChan,
-              unsigned long numFrames, unsigned int srate, SAMPLE *theWave)
+              unsigned long numFrames, unsigned int srate)
     {
         cout << numFrames << endl;
         this->name = myName;
@@ -53,24 +75,80 @@ struct AudioFile {
         this->frames = numFrames;
         this->channels = numChan;
         this->sampleRate = srate;
-        this->wave = theWave;
+        this->format = AUDIOFILE_FLOAT64;
+        this->scale = 1.0;
+        this->waveData = allocateWave(numFrames, numChan, format, &this->wave);
+        this->numLevels = 1;
+        this->levelWave[0] = this->wave;
+        this->levelData[0] = NULL;  // owned as waveData
+        this->levelFrames[0] = this->frames;
+        for (unsigned int k = 0; k < AUDIOFILE_MAX_LEVELS; k++)
+            this->levelPeaks[k] = NULL;
     }
     // destructor
     ~AudioFile()
     {
-        if (wave != NULL) {
-            delete[] wave;
+        freeLevels();
+        if (waveData != NULL) {
+            delete[] waveData;
         }
     }
 
+    // (float64 only)
     void resampleTo(unsigned int newRate);
 
+    // build the decimated levels of the waveform, up to maxLevels in total,
+    // and the peak index of every level (float64 only)
+    void buildLevels(unsigned int maxLevels);
+    // delete the decimated levels and the peak index, keeping the waveform
+    void freeLevels();
+
+    // highest absolute sample value of the frames first to last of a level,
+    // at block precision.  without an index, the sound counts as loud.
+    double spanPeak(unsigned int level, unsigned long first, unsigned long last) const;
+
+    // convert the float64 waveform and its levels to another format
+    void convertTo(int newFormat);
+
+    // value of a sample of the waveform, whatever the format
+    double sampleAt(unsigned long frame, unsigned int chan) const;
+
+    // size of a sample in a format
+    static unsigned int sampleBytes(int format);
+
+    // allocate a zeroed waveform surrounded by guard frames.  returns the
+    // allocation, and the position of the first frame in *wavePtr.
+    static char *allocateWave(unsigned long numFrames, unsigned int numChan,
+                              int format, void **wavePtr);
+
     string name;
     string path;
-    SAMPLE *wave;
+    // storage format of the samples, and value of one unit of an int16
+    int format;
+    double scale;
+    // first frame of the waveform, inside of waveData
+    void *wave;
+    // allocation which holds the waveform and its guard frames
+    char *waveData;
     unsigned long frames;
     unsigned int channels;
     unsigned int sampleRate;
+
+    // octave pyramid: level k is the waveform band-limited and decimated by
+    // 2^k, with guard frames.  level 0 is the waveform itself.
+    unsigned int numLevels;
+    void *levelWave[AUDIOFILE_MAX_LEVELS];
+    char *levelData[AUDIOFILE_MAX_LEVELS];
+    unsigned long levelFrames[AUDIOFILE_MAX_LEVELS];
+
+    // peak index: highest absolute value of each block of
+    // AUDIOFILE_PEAK_BLOCK frames of a level, over all channels
+    float *levelPeaks[AUDIOFILE_MAX_LEVELS];
+
+protected:
+    // index the peaks of the float64 levels / delete the index
+    void buildPeaks();
+    void freePeaks();
 };
 
 
@@ -82,8 +160,10 @@ public:
     // constructor
     AudioFileSet();
 
-    // read in all audio files contained in
-    int loadFileSet(string path);
+    // read in all audio files contained in, building up to numLevels
+    // octave levels of each (1 for none), and storing them in a format
+    int loadFileSet(string path, unsigned int numLevels = AUDIOFILE_MAX_LEVELS,
+                    int format = AUDIOFILE_FLOAT64);
 
     // return the audio vector- note, the intension is for the files to be
     // read only.  if write access is needed in the future - thread safety will
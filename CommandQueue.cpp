@@ -0,0 +1,73 @@
+//------------------------------------------------------------------------------
+// FRONTIÈRES:  An interactive granular sampler.
+//------------------------------------------------------------------------------
+// More information is available at
+//     http::/ccrma.stanford.edu/~carlsonc/256a/Borderlands/index.html
+//
+//
+// Copyright (C) 2018  Jean Pierre Cimalando
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 3.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+
+//
+//  CommandQueue.cpp
+//  Frontières
+//
+
+#include "CommandQueue.h"
+
+
+//-----------------------------------------------------------------------------
+// Constructor / destructor
+//-----------------------------------------------------------------------------
+CommandQueue::~CommandQueue()
+{
+    delete commands;
+}
+
+CommandQueue::CommandQueue(unsigned int capacity)
+{
+    commands = new Ring_Buffer(capacity * sizeof(EngineCommand));
+}
+
+
+//-----------------------------------------------------------------------------
+// GUI thread
+//-----------------------------------------------------------------------------
+bool CommandQueue::post(int type, GrainCluster *cloud, double value)
+{
+    if (!canPost())
+        return false;
+
+    EngineCommand cmd;
+    cmd.type = type;
+    cmd.cloud = cloud;
+    cmd.value = value;
+    return commands->put(cmd);
+}
+
+bool CommandQueue::canPost()
+{
+    return commands->size_free() >= sizeof(EngineCommand);
+}
+
+
+//-----------------------------------------------------------------------------
+// Audio thread
+//-----------------------------------------------------------------------------
+bool CommandQueue::next(EngineCommand *cmd)
+{
+    return commands->get(*cmd);
+}
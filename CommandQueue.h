@@ -0,0 +1,85 @@
+//------------------------------------------------------------------------------
+// FRONTIÈRES:  An interactive granular sampler.
+//------------------------------------------------------------------------------
+// More information is available at
+//     http::/ccrma.stanford.edu/~carlsonc/256a/Borderlands/index.html
+//
+//
+// Copyright (C) 2018  Jean Pierre Cimalando
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 3.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+
+//
+//  CommandQueue.h
+//  Frontières
+//
+//  Changes to the set of clouds, made by the GUI and applied by the audio
+//  thread at the start of a block.  The GUI builds the objects, the audio
+//  thread only links them in or out, and removed ones are deleted through
+//  the Reclaimer: neither side locks, and the audio thread never allocates
+//  or frees.
+//
+
+#ifndef COMMANDQUEUE_H
+#define COMMANDQUEUE_H
+
+#include <ring_buffer.h>
+
+class GrainCluster;
+
+// most clouds playing at once
+enum { MAX_CLOUDS = 128 };
+
+// requests of the GUI
+enum {
+    CMD_ADD_CLOUD,  // start playing a cloud
+    CMD_REMOVE_CLOUD,  // stop playing a cloud (the GUI retires it)
+    CMD_ADD_GRAIN,  // one more grain voice in a cloud
+    CMD_REMOVE_GRAIN,  // one less
+    CMD_FREEZE,  // loop the output of a cloud (value: frames of the loop)
+    CMD_UNFREEZE  // back to the grains
+};
+
+struct EngineCommand {
+    int type;
+    GrainCluster *cloud;
+    // argument of the command, if it has one
+    double value;
+};
+
+class CommandQueue {
+
+public:
+    // destructor
+    ~CommandQueue();
+
+    // constructor, with the number of commands which may wait
+    CommandQueue(unsigned int capacity);
+
+    // GUI thread: queue a command, returns false if it does not fit
+    bool post(int type, GrainCluster *cloud, double value = 0.0);
+
+    // GUI thread: whether a command would fit
+    bool canPost();
+
+    // audio thread: take the next command, returns false if there is none
+    bool next(EngineCommand *cmd);
+
+private:
+    // commands to the audio thread
+    Ring_Buffer *commands;
+};
+
+#endif
@@ -57,6 +57,12 @@
 #include "MyRtAudio.h"
 #include "AudioFileSet.h"
 #include "Window.h"
+#include "MasterBus.h"
+#include "LoadGovernor.h"
+#include "RenderWorkers.h"
+#include "CommandQueue.h"
+#include "Reclaimer.h"
+#include "Scene.h"
 
 // midi related
 #include <RtMidi.h>
@@ -104,6 +110,26 @@ vector<SoundRect *> *soundViews = NULL;
 vector<GrainCluster *> *grainCloud = NULL;
 // grain cloud visualization objects
 vector<GrainClusterVis *> *grainCloudVis;
+// grain voices shared by the clouds
+GrainVoicePool *voicePool = NULL;
+// output stage, after all clouds
+MasterBus *masterBus = NULL;
+// quality steps under load
+LoadGovernor *loadGovernor = NULL;
+// threads helping to render the clouds
+RenderWorkers *renderWorkers = NULL;
+// changes to the clouds, from the GUI to the audio thread
+CommandQueue *engineCommands = NULL;
+// deletion of what the audio thread may still read
+Reclaimer *reclaimer = NULL;
+// geometry of the landscape for the audio thread
+Scene *theScene = NULL;
+// maximum number of grains playing at once
+unsigned int g_voiceBudget = 512;
+// storage format of the sounds in memory
+int g_sampleFormat = AUDIOFILE_FLOAT32;
+// number of decimated copies kept of each sound, the original included
+unsigned int g_soundLevels = AUDIOFILE_MAX_LEVELS;
 // cloud counter
 unsigned int numClouds = 0;
 
@@ -166,6 +192,7 @@ int audioCallback(void *outputBuffer, void *inputBuffer, unsigned int numFrames,
                   double streamTime, RtAudioStreamStatus status, void *userData);
 void processMidiMessage(const unsigned char *message, unsigned length);
 void midiInCallback(double timeStamp, std::vector<unsigned char> *message, void *userData);
+static void processCommands();
 
 
 //--------------------------------------------------------------------------------
@@ -203,6 +230,31 @@ void cleaningFunction()
     if (grainCloudVis != NULL) {
         delete grainCloudVis;
     }
+    if (engineCommands != NULL) {
+        // the stream is stopped: the clouds removed last give their voices
+        // back here, before the reclaimer frees them
+        processCommands();
+        delete engineCommands;
+    }
+    if (theScene != NULL) {
+        delete theScene;
+    }
+    if (reclaimer != NULL) {
+        Window::Instance().setReclaimer(NULL);
+        delete reclaimer;
+    }
+    if (voicePool != NULL) {
+        delete voicePool;
+    }
+    if (masterBus != NULL) {
+        delete masterBus;
+    }
+    if (loadGovernor != NULL) {
+        delete loadGovernor;
+    }
+    if (renderWorkers != NULL) {
+        delete renderWorkers;
+    }
     if (soundViews != NULL) {
         delete soundViews;
     }
@@ -219,10 +271,67 @@ void cleaningFunction()
 //   Audio Callback
 //================================================================================
 
+// clouds the audio thread plays (it alone changes this list, as the GUI
+// asks through engineCommands)
+static GrainCluster *audioClouds[MAX_CLOUDS];
+static unsigned int numAudioClouds = 0;
+
+// frames of the block being rendered
+static unsigned int renderFrames = 0;
+
+// render a cloud (a job of the render workers)
+static void renderCloud(void *arg, unsigned int index)
+{
+    GrainCluster **clouds = (GrainCluster **)arg;
+    clouds[index]->render(renderFrames);
+}
+
+// apply the changes the GUI asked for, at the start of a block
+static void processCommands()
+{
+    EngineCommand cmd;
+    while (engineCommands->next(&cmd)) {
+        switch (cmd.type) {
+        case CMD_ADD_CLOUD:
+            // (the GUI keeps to MAX_CLOUDS)
+            if (numAudioClouds < MAX_CLOUDS)
+                audioClouds[numAudioClouds++] = cmd.cloud;
+            break;
+        case CMD_REMOVE_CLOUD:
+            // keep the order of the others, the GUI lists them the same way
+            for (unsigned int i = 0; i < numAudioClouds; i++) {
+                if (audioClouds[i] == cmd.cloud) {
+                    for (unsigned int j = i + 1; j < numAudioClouds; j++)
+                        audioClouds[j - 1] = audioClouds[j];
+                    numAudioClouds--;
+                    break;
+                }
+            }
+            cmd.cloud->releaseVoices();
+            break;
+        case CMD_ADD_GRAIN:
+            cmd.cloud->addGrain();
+            break;
+        case CMD_REMOVE_GRAIN:
+            cmd.cloud->removeGrain();
+            break;
+        case CMD_FREEZE:
+            cmd.cloud->startFreeze((unsigned long)cmd.value);
+            break;
+        case CMD_UNFREEZE:
+            cmd.cloud->stopFreeze();
+            break;
+        }
+    }
+}
+
 // audio callback
 int audioCallback(void *outputBuffer, void *inputBuffer, unsigned int numFrames,
                   double streamTime, RtAudioStreamStatus status, void *userData)
 {
+    // time spent in here, against the buffer period
+    loadGovernor->beginBlock();
+
     // process the midi messages
     unsigned char midiMessageSize;
     unsigned char midiMessageBuffer[256];
@@ -238,13 +347,42 @@ int audioCallback(void *outputBuffer, void *inputBuffer, unsigned int numFrames,
     SAMPLE *out = (SAMPLE *)outputBuffer;
     SAMPLE *in = (SAMPLE *)inputBuffer;
 
+    // clouds added or removed, grains added or removed
+    processCommands();
+
     memset(out, 0, sizeof(SAMPLE) * numFrames * MY_CHANNELS);
     if (menuFlag == false) {
-        for (int i = 0; i < grainCloud->size(); i++) {
-            grainCloud->at(i)->nextBuffer(out, numFrames);
+        // under load, the clouds not being edited are thinned first
+        int maxInterp = loadGovernor->maxInterpolation();
+        double voiceScale = loadGovernor->voiceScale();
+        double density = loadGovernor->densityScale(false);
+        double backgroundDensity = loadGovernor->densityScale(true);
+        for (unsigned int i = 0; i < numAudioClouds; i++)
+            audioClouds[i]->setLoadLimits(maxInterp, voiceScale, density, backgroundDensity);
+
+        // the clouds trigger in turn, render on the workers, and are summed
+        // in order, so the output is the same whatever thread renders what
+        for (unsigned int done = 0; done < numFrames;) {
+            unsigned int frames = numFrames - done;
+            if (frames > CLUSTER_MAX_FRAMES)
+                frames = CLUSTER_MAX_FRAMES;
+            renderFrames = frames;
+            for (unsigned int i = 0; i < numAudioClouds; i++)
+                audioClouds[i]->schedule(frames);
+            renderWorkers->run(&renderCloud, audioClouds, numAudioClouds);
+            voicePool->endBlock();
+            for (unsigned int i = 0; i < numAudioClouds; i++)
+                audioClouds[i]->mixInto(&out[done * MY_CHANNELS], frames);
+            done += frames;
         }
     }
+    masterBus->process(out, numFrames);
     GTime::instance().sec += numFrames * samp_time_sec;
+
+    loadGovernor->endBlock(numFrames, (status & RTAUDIO_OUTPUT_UNDERFLOW) != 0);
+
+    // nothing retired before this callback is read anymore
+    reclaimer->advance();
     // cout << GTime::instance().sec<<endl;
     return 0;
 }
@@ -475,6 +613,18 @@ void printParam()
             case SINC:
                 myValue = _S("", "Window: SINC");
                 break;
+            case TUKEY:
+                myValue = _S("", "Window: TUKEY");
+                break;
+            case GAUSSIAN:
+                myValue = _S("", "Window: GAUSSIAN");
+                break;
+            case BLACKMAN_HARRIS:
+                myValue = _S("", "Window: BLACKMAN_HARRIS");
+                break;
+            case TRAPEZOID:
+                myValue = _S("", "Window: TRAPEZOID");
+                break;
             case RANDOM_WIN:
                 myValue = _S("", "Window: RANDOM_WIN");
                 break;
@@ -483,6 +633,52 @@ void printParam()
                 break;
             }
 
+            draw_string((GLfloat)mouseX, (GLfloat)(screenHeight - mouseY), 0.0,
+                        myValue.c_str(), 100.0f);
+            break;
+        case WINDOW_PARAM:
+            myValue = _S("", "Window parameter: ");
+            if (paramString != "") {
+                myValue = myValue + paramString;
+            }
+            else if (theCloud->getWindowParam() >= 0.0) {
+                sinput << theCloud->getWindowParam();
+                myValue = myValue + sinput.str();
+            }
+            else {
+                myValue = myValue + _S("", "none");
+            }
+            draw_string((GLfloat)mouseX, (GLfloat)(screenHeight - mouseY), 0.0,
+                        myValue.c_str(), 100.0f);
+            break;
+        case WINDOW_LENGTH:
+            myValue = _S("", "Window length: ");
+            if (paramString != "") {
+                myValue = myValue + paramString;
+            }
+            else {
+                sinput << theCloud->getWindowLength();
+                myValue = myValue + sinput.str();
+            }
+            draw_string((GLfloat)mouseX, (GLfloat)(screenHeight - mouseY), 0.0,
+                        myValue.c_str(), 100.0f);
+            break;
+        case INTERPOLATION:
+            switch (theCloud->getInterpolation()) {
+            case INTERP_LINEAR:
+                myValue = _S("", "Interpolation: LINEAR");
+                break;
+            case INTERP_HERMITE:
+                myValue = _S("", "Interpolation: HERMITE");
+                break;
+            case INTERP_SINC:
+                myValue = _S("", "Interpolation: SINC");
+                break;
+            default:
+                myValue = "";
+                break;
+            }
+
             draw_string((GLfloat)mouseX, (GLfloat)(screenHeight - mouseY), 0.0,
                         myValue.c_str(), 100.0f);
             break;
@@ -804,6 +1000,8 @@ int main(int argc, char **argv)
         ::samp_rate = sampleRate;
         ::samp_time_sec = 1.0 / sampleRate;
         Stk::setSampleRate(sampleRate);
+        masterBus = new MasterBus(sampleRate);
+        loadGovernor = new LoadGovernor(sampleRate);
         // open audio stream/assign callback
         theAudio->openStream(&audioCallback);
         // get new buffer size
@@ -866,9 +1064,31 @@ int main(int argc, char **argv)
     cout << "Audio path of system: " << audioPathDefault << "\n";
     cout << "Audio path used: " << g_audioPath << "\n";
 
+    // the storage format can be changed for memory or for precision
+    if (const char *format = getenv("FRONTIERES_SAMPLE_FORMAT")) {
+        if (!strcmp(format, "float64"))
+            g_sampleFormat = AUDIOFILE_FLOAT64;
+        else if (!strcmp(format, "float32"))
+            g_sampleFormat = AUDIOFILE_FLOAT32;
+        else if (!strcmp(format, "int16"))
+            g_sampleFormat = AUDIOFILE_INT16;
+        else
+            cerr << "Unknown sample format: " << format << "\n";
+    }
+
+    // the octave levels speed up grains played above the original pitch,
+    // at the cost of memory and load time.  1 keeps the original only.
+    if (const char *levels = getenv("FRONTIERES_SOUND_LEVELS")) {
+        int numLevels = atoi(levels);
+        if (numLevels >= 1 && numLevels <= AUDIOFILE_MAX_LEVELS)
+            g_soundLevels = (unsigned int)numLevels;
+        else
+            cerr << "Invalid number of sound levels: " << levels << "\n";
+    }
+
     AudioFileSet newFileMgr;
 
-    if (newFileMgr.loadFileSet(g_audioPath) == 1) {
+    if (newFileMgr.loadFileSet(g_audioPath, g_soundLevels, g_sampleFormat) == 1) {
         goto cleanup;
     }
 
@@ -880,14 +1100,32 @@ int main(int argc, char **argv)
     soundViews = new vector<SoundRect *>;
     for (int i = 0; i < mySounds->size(); i++) {
         soundViews->push_back(new SoundRect());
-        soundViews->at(i)->associateSound(mySounds->at(i)->wave, mySounds->at(i)->frames,
-                                          mySounds->at(i)->channels);
+        soundViews->at(i)->associateSound(mySounds->at(i));
     }
 
     // init grain cloud vector and corresponding view vector
     grainCloud = new vector<GrainCluster *>;
     grainCloudVis = new vector<GrainClusterVis *>;
 
+    // preallocate the grain voices, clouds steal from each other past the budget
+    voicePool = new GrainVoicePool(mySounds, g_voiceBudget);
+    voicePool->setStealMode(STEAL_OLDEST);
+    engineCommands = new CommandQueue(256);
+    reclaimer = new Reclaimer();
+    Window::Instance().setReclaimer(reclaimer);
+    theScene = new Scene(reclaimer);
+    theScene->publish(*soundViews);
+
+    // helpers for the audio thread, one less than the cores by default
+    {
+        unsigned int numThreads = std::thread::hardware_concurrency();
+        numThreads = (numThreads > 1) ? numThreads - 1 : 0;
+        if (const char *threads = getenv("FRONTIERES_RENDER_THREADS"))
+            numThreads = (unsigned int)atoi(threads);
+        renderWorkers = new RenderWorkers(numThreads);
+        cout << "Render threads: " << renderWorkers->getNumThreads() << "\n";
+    }
+
 
     // start audio stream
     theAudio->startStream();
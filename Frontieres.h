@@ -27,6 +27,13 @@
 class SoundRect;
 class GrainCluster;
 class GrainClusterVis;
+class GrainVoicePool;
+class MasterBus;
+class LoadGovernor;
+class RenderWorkers;
+class CommandQueue;
+class Reclaimer;
+class Scene;
 struct AudioFile;
 class QtFont3D;
 
@@ -74,6 +81,20 @@ extern std::vector<SoundRect *> *soundViews;
 extern std::vector<GrainCluster *> *grainCloud;
 // grain cloud visualization objects
 extern std::vector<GrainClusterVis *> *grainCloudVis;
+// grain voices shared by the clouds
+extern GrainVoicePool *voicePool;
+// output stage, after all clouds
+extern MasterBus *masterBus;
+// quality steps under load
+extern LoadGovernor *loadGovernor;
+// threads helping to render the clouds
+extern RenderWorkers *renderWorkers;
+// changes to the clouds, from the GUI to the audio thread
+extern CommandQueue *engineCommands;
+// deletion of what the audio thread may still read
+extern Reclaimer *reclaimer;
+// geometry of the landscape for the audio thread
+extern Scene *theScene;
 // cloud counter
 extern unsigned int numClouds;
 
@@ -101,7 +122,10 @@ enum {
     P_LFO_FREQ,
     P_LFO_AMT,
     SPATIALIZE,
-    VOLUME
+    VOLUME,
+    INTERPOLATION,
+    WINDOW_PARAM,
+    WINDOW_LENGTH
 };
 
 // flag indicating parameter change
@@ -46,6 +46,16 @@ SOURCES += \
   MyRtAudio.cpp \
   Window.cpp \
   GrainVoice.cpp \
+  GrainKernel.cpp \
+  GrainEnvelope.cpp \
+  MasterBus.cpp \
+  LoadGovernor.cpp \
+  Random.cpp \
+  ModMatrix.cpp \
+  RenderWorkers.cpp \
+  CommandQueue.cpp \
+  Reclaimer.cpp \
+  Scene.cpp \
   GrainCluster.cpp \
   Thread.cpp \
   MyGLApplication.cpp \
@@ -74,4 +84,15 @@ HEADERS += \
   Window.h \
   MyRtAudio.h \
   GrainVoice.h \
+  GrainKernel.h \
+  GrainEnvelope.h \
+  MasterBus.h \
+  LoadGovernor.h \
+  Random.h \
+  ModMatrix.h \
+  RenderWorkers.h \
+  CommandQueue.h \
+  TripleBuffer.h \
+  Reclaimer.h \
+  Scene.h \
   Thread.h
@@ -29,48 +29,75 @@
 #include "GrainCluster.h"
 #include "MyGLApplication.h"
 #include "MyGLWindow.h"
+#include "CommandQueue.h"
+#include <string.h>
+#include <assert.h>
 
 extern unsigned int samp_rate;
 
 
+// let go of the window tables of a setting
+static void releaseWindows(const ClusterParams &p)
+{
+    Window &windows = Window::Instance();
+    if (p.window)
+        windows.releaseWindow(p.window);
+    for (int i = 0; i < RANDOM_WIN; i++) {
+        if (p.randomWindows[i])
+            windows.releaseWindow(p.randomWindows[i]);
+    }
+}
+
+
 // Destructor
 GrainCluster::~GrainCluster()
 {
-    if (myGrains != NULL) {
-        for (int i = 0; i < myGrains->size(); i++) {
-            delete myGrains->at(i);
-        }
-        delete myGrains;
-    }
+    // the audio thread gave the voices back at CMD_REMOVE_CLOUD
+    assert(myVoices.first == -1);
+    releaseWindows(guiParams);
+    delete[] memo.data;
+    delete[] renderBuff;
+    if (freezeLoop)
+        delete[] freezeLoop;
 
     if (myVis)
         delete myVis;
-    if (myLock)
-        delete myLock;
     if (channelMults)
         delete[] channelMults;
 }
 
 
 // Constructor
-GrainCluster::GrainCluster(vector<AudioFile *> *soundSet, float theNumVoices)
+GrainCluster::GrainCluster(vector<AudioFile *> *soundSet, GrainVoicePool *pool, Scene *scene,
+                           CommandQueue *commands, float theNumVoices)
 {
-    // initialize mutext
-    myLock = new Mutex();
     // cluster id
     myId = ++clusterId;
 
-    // playback bool to make sure we precisely time grain triggers
-    awaitingPlay = false;
-
     // number of voices
     numVoices = theNumVoices;
-    // initialize random number generator (for random motion)
-    srand(time(NULL));
-
-    // initialize interfacing flags
-    addFlag = false;
-    removeFlag = false;
+    // random numbers of the grains, the same for each run
+    rng.seed(myId);
+    guiParams.seed = myId;
+    guiParams.seedCount = 0;
+    rngSeedCount = 0;
+
+    // full quality until the load governor says otherwise
+    loadInterp = NUM_INTERP_TYPES - 1;
+    loadVoices = 1.0;
+    loadDensity = 1.0;
+    loadBackgroundDensity = 1.0;
+
+    // not frozen, the loop is allocated by the first freeze
+    freezeAsked = false;
+    freezeRequest = 0;
+    freezeState = FREEZE_OFF;
+    freezeLoop = NULL;
+    freezeLength = 0;
+    freezeFade = 0;
+    freezePos = 0;
+    fadePos = 0;
+    fadeGrains = false;
 
     // keep pointer to the sound set
     theSounds = soundSet;
@@ -82,17 +109,34 @@ GrainCluster::GrainCluster(vector<AudioFile *> *soundSet, float theNumVoices)
     local_time = 0;
 
     // default duration (ms)
-    duration = 500.0;
+    guiParams.duration = 500.0;
 
     // default pitch
-    pitch = 1.0f;
+    guiParams.pitch = 1.0f;
 
     // default window type
-    windowType = HANNING;
+    guiParams.windowParam = -1.0;
+    guiParams.windowLength = WINDOW_LEN;
+    guiParams.window = NULL;
+    for (int i = 0; i < RANDOM_WIN; i++)
+        guiParams.randomWindows[i] = NULL;
+    setWindowType(HANNING);
+
+    // default interpolation
+    guiParams.interpType = INTERP_LINEAR;
+
+    // not selected until the GUI says so
+    guiParams.selected = false;
+
+    // the pitch LFO is the first LFO of the modulation, on the first route
+    guiParams.mods.setLFO(0, LFO_SINE, 0.01);
+    guiParams.mods.setRoute(0, MOD_LFO1, MOD_PITCH, 0.0);
 
-    // initialize pitch LFO
-    pitchLFOFreq = 0.01f;
-    pitchLFOAmount = 0.0f;
+    // state - (user can remove cloud from "play" for editing).  the audio
+    // thread starts the envelopes at the first activation.
+    guiParams.active = true;
+    guiParams.activations = 1;
+    modActivations = 0;
 
     // initialize channel multiplier array
     channelMults = new double[MY_CHANNELS];
@@ -105,18 +149,36 @@ GrainCluster::GrainCluster(vector<AudioFile *> *soundSet, float theNumVoices)
     side = 1;
 
 
-    spatialMode = UNITY;
-    channelLocation = -1;
+    guiParams.spatialMode = UNITY;
+    guiParams.channelLocation = -1;
 
-    myDirMode = RANDOM_DIR;
+    guiParams.dirMode = RANDOM_DIR;
 
-    // create grain voice vector
-    myGrains = new vector<GrainVoice *>;
+    // no visualization yet: grains at the origin
+    myVis = NULL;
+    guiParams.centerX = 0.0f;
+    guiParams.centerY = 0.0f;
+    guiParams.xRandExtent = 0.0f;
+    guiParams.yRandExtent = 0.0f;
+    theScene = scene;
+    theCommands = commands;
+    blockGeometry = NULL;
 
-    // populate grain cloud
-    for (int i = 0; i < numVoices; i++) {
-        myGrains->push_back(new GrainVoice(theSounds, duration, pitch));
-    }
+    // voices are borrowed from the pool at each trigger
+    thePool = pool;
+    myVoices.first = -1;
+    myVoices.count = 0;
+
+    // the grains render into a buffer of the cloud, mixed afterwards
+    renderBuff = new double[(CLUSTER_MAX_FRAMES + GRAIN_STEAL_FADE) * MY_CHANNELS]();
+    myVoices.buffer = renderBuff;
+    grainFrames = 0;
+    rendered = false;
+
+    // memoized grain, recorded while the first grain of a static cloud plays
+    memo.valid = false;
+    memo.users = 0;
+    memo.data = new float[GRAIN_MEMO_FRAMES * MY_CHANNELS];
 
     // set volume of cloud to unity
     setVolumeDb(0.0);
@@ -127,16 +189,10 @@ GrainCluster::GrainCluster(vector<AudioFile *> *soundSet, float theNumVoices)
     //    //direction
     //    setDirection(RANDOM_DIR);
 
-    // initialize trigger time (samples)
-    bang_time = duration * ::samp_rate * (double)0.001 / overlap;
-
-    // load grains
-    for (int i = 0; i < myGrains->size(); i++) {
-        myGrains->at(i)->setDurationMs(duration);
-    }
-
-    // state - (user can remove cloud from "play" for editing)
-    isActive = true;
+    // the audio thread starts from these
+    publishParams();
+    paramBuffer.update();
+    blockParams = &paramBuffer.read();
 }
 
 
@@ -144,61 +200,168 @@ GrainCluster::GrainCluster(vector<AudioFile *> *soundSet, float theNumVoices)
 void GrainCluster::registerVis(GrainClusterVis *vis)
 {
     myVis = vis;
-    myVis->setDuration(duration);
+    myVis->setDuration(guiParams.duration);
+    updateGeometry();
+}
+
+void GrainCluster::updateGeometry()
+{
+    unfreeze();
+    guiParams.centerX = myVis->getX();
+    guiParams.centerY = myVis->getY();
+    guiParams.xRandExtent = myVis->getXRandExtent();
+    guiParams.yRandExtent = myVis->getYRandExtent();
+    publishParams();
 }
 
 // turn on/off
 void GrainCluster::toggleActive()
 {
-    isActive = !isActive;
+    guiParams.active = !guiParams.active;
+    if (guiParams.active)
+        guiParams.activations++;
+    publishParams();
 }
 
 bool GrainCluster::getActiveState()
 {
-    return isActive;
+    return guiParams.active;
+}
+
+// selection, only published when it changes
+void GrainCluster::setSelected(bool selected)
+{
+    if (guiParams.selected != selected) {
+        guiParams.selected = selected;
+        publishParams();
+    }
 }
 
 
 // set window type
 void GrainCluster::setWindowType(int winType)
 {
+    unfreeze();
     int numWins = Window::Instance().numWindows();
-    windowType = winType % numWins;
+    int windowType = winType % numWins;
 
     if (windowType < 0) {
         windowType = Window::Instance().numWindows() - 1;
     }
-    if (windowType == RANDOM_WIN) {
-        for (int i = 0; i < myGrains->size(); i++) {
-            myGrains->at(i)->setWindow(
-                (int)floor(randf() * Window::Instance().numWindows() - 1));
+
+    // each shape starts from its default parameter
+    findWindows(windowType, -1.0, guiParams.windowLength);
+}
+
+bool GrainCluster::findWindows(int windowType, double param, unsigned int length)
+{
+    Window &windows = Window::Instance();
+    const WindowTable *found[RANDOM_WIN];
+    unsigned int numFound = (windowType == RANDOM_WIN) ? RANDOM_WIN : 1;
+
+    for (unsigned int i = 0; i < numFound; i++) {
+        if (windowType == RANDOM_WIN)
+            found[i] = windows.getWindow(i, -1.0, length);
+        else
+            found[i] = windows.getWindow(windowType, param, length);
+        if (!found[i]) {
+            cerr << "Too many window tables, the window is unchanged\n";
+            while (i > 0)
+                windows.releaseWindow(found[--i]);
+            return false;
         }
     }
-    else {
 
-        for (int i = 0; i < myGrains->size(); i++) {
-            // cout << "windowtype " << windowType << endl;
-            myGrains->at(i)->setWindow(windowType);
-        }
+    // the setting only holds the tables it plays
+    ClusterParams old = guiParams;
+    guiParams.windowType = windowType;
+    guiParams.windowParam = param;
+    guiParams.windowLength = found[0]->length;
+    guiParams.window = NULL;
+    for (int i = 0; i < RANDOM_WIN; i++)
+        guiParams.randomWindows[i] = NULL;
+    if (windowType == RANDOM_WIN) {
+        for (int i = 0; i < RANDOM_WIN; i++)
+            guiParams.randomWindows[i] = found[i];
+    }
+    else {
+        guiParams.window = found[0];
     }
+
+    // the old tables go once the audio thread has the new ones
+    publishParams();
+    releaseWindows(old);
+    return true;
 }
 
 int GrainCluster::getWindowType()
 {
-    return windowType;
+    return guiParams.windowType;
+}
+
+void GrainCluster::setWindowParam(double theParam)
+{
+    unfreeze();
+    findWindows(guiParams.windowType, theParam, guiParams.windowLength);
 }
 
+double GrainCluster::getWindowParam()
+{
+    if (guiParams.windowType == RANDOM_WIN || !Window::hasParam(guiParams.windowType))
+        return -1.0;
+    return guiParams.window->param;
+}
+
+void GrainCluster::setWindowLength(unsigned int theLength)
+{
+    unfreeze();
+    findWindows(guiParams.windowType, guiParams.windowParam, theLength);
+}
 
+unsigned int GrainCluster::getWindowLength()
+{
+    return guiParams.windowLength;
+}
+
+
+// set interpolation quality (wraps around)
+void GrainCluster::setInterpolation(int theInterp)
+{
+    unfreeze();
+    int interpType = theInterp % NUM_INTERP_TYPES;
+    if (interpType < 0)
+        interpType = NUM_INTERP_TYPES - 1;
+    guiParams.interpType = interpType;
+    publishParams();
+}
+
+int GrainCluster::getInterpolation()
+{
+    return guiParams.interpType;
+}
+
+
+// add/remove a grain voice (on the audio thread, see CommandQueue; the
+// overlap follows at the next block)
 void GrainCluster::addGrain()
 {
-    addFlag = true;
-    myVis->addGrain();
+    numVoices += 1;
 }
 
 void GrainCluster::removeGrain()
 {
-    removeFlag = true;
-    myVis->removeGrain();
+    if (numVoices > 1) {
+        if (nextGrain >= numVoices - 1) {
+            nextGrain = 0;
+        }
+        numVoices -= 1;
+    }
+}
+
+// give the voices back to the pool (on the audio thread, as it is removed)
+void GrainCluster::releaseVoices()
+{
+    thePool->release(&myVoices);
 }
 
 
@@ -212,64 +375,59 @@ unsigned int GrainCluster::getId()
 // overlap (input on 0 to 1 scale)
 void GrainCluster::setOverlap(float target)
 {
+    unfreeze();
     if (target > 1.0f)
         target = 1.0f;
     else if (target < 0.0f)
         target = 0.0f;
-    overlapNorm = target;
-    // oops wrong!//overlap = ((float)(myGrains->size()))*0.25f*exp(log(2.0f)*target);
-
-    float num = (float)myGrains->size();
-
-    overlap = exp(log(num) * target);
-
-    //  cout<<"overlap set" << overlap << endl;
-    updateBangTime();
+    // (the overlap itself depends on the number of voices, see
+    // updateModulation)
+    guiParams.overlapNorm = target;
+    publishParams();
 }
 
 float GrainCluster::getOverlap()
 {
-    return overlapNorm;
+    return guiParams.overlapNorm;
 }
 
 // duration
 void GrainCluster::setDurationMs(float theDur)
 {
+    unfreeze();
     if (theDur >= 1.0f) {
-        duration = theDur;
-        for (int i = 0; i < myGrains->size(); i++)
-            myGrains->at(i)->setDurationMs(duration);
-
-        updateBangTime();
+        guiParams.duration = theDur;
+        publishParams();
 
         // notify visualization
         if (myVis)
-            myVis->setDuration(duration);
+            myVis->setDuration(theDur);
     }
 }
 
-// update internal grain trigger time
-void GrainCluster::updateBangTime()
+// hand the parameters over to the audio thread, which takes them at its
+// next block
+void GrainCluster::publishParams()
 {
-    bang_time = duration * ::samp_rate * (double)0.001 / overlap;
-    // cout << "duration: " << duration << ", new bang time " << bang_time << endl;
+    paramBuffer.write() = guiParams;
+    paramBuffer.publish();
 }
 
 
 // pitch
 void GrainCluster::setPitch(float targetPitch)
 {
+    unfreeze();
     if (targetPitch < 0.0001) {
         targetPitch = 0.0001;
     }
-    pitch = targetPitch;
-    for (int i = 0; i < myGrains->size(); i++)
-        myGrains->at(i)->setPitch(targetPitch);
+    guiParams.pitch = targetPitch;
+    publishParams();
 }
 
 float GrainCluster::getPitch()
 {
-    return pitch;
+    return guiParams.pitch;
 }
 
 
@@ -278,6 +436,7 @@ float GrainCluster::getPitch()
 //-----------------------------------------------------------------
 void GrainCluster::setVolumeDb(float volDb)
 {
+    unfreeze();
     // max = 6 db, min = -60 db
     if (volDb > 6.0) {
         volDb = 6.0;
@@ -287,195 +446,445 @@ void GrainCluster::setVolumeDb(float volDb)
         volDb = -60.0;
     }
 
-    volumeDb = volDb;
+    guiParams.volumeDb = volDb;
 
     // convert to 0-1 representation
-    normedVol = pow(10.0, volDb * 0.05);
-
-    for (int i = 0; i < myGrains->size(); i++)
-        myGrains->at(i)->setVolume(normedVol);
+    guiParams.normedVol = pow(10.0, volDb * 0.05);
+    publishParams();
 }
 
 float GrainCluster::getVolumeDb()
 {
-    return volumeDb;
+    return guiParams.volumeDb;
 }
 
 
 // direction mode
 void GrainCluster::setDirection(int dirMode)
 {
-    myDirMode = dirMode % 3;
-    if (myDirMode < 0) {
-        myDirMode = 2;
+    unfreeze();
+    guiParams.dirMode = dirMode % 3;
+    if (guiParams.dirMode < 0) {
+        guiParams.dirMode = 2;
     }
+    publishParams();
     // cout << "dirmode num" << myDirMode << endl;
-    switch (myDirMode) {
-    case FORWARD:
-        //      cout << "set for" << endl;
-        for (int i = 0; i < myGrains->size(); i++)
-            myGrains->at(i)->setDirection(1.0);
-        break;
-    case BACKWARD:
-        //    cout << "set back" << endl;
-        for (int i = 0; i < myGrains->size(); i++)
-            myGrains->at(i)->setDirection(-1.0);
-        break;
-    case RANDOM_DIR:
-        for (int i = 0; i < myGrains->size(); i++) {
-            if (randf() > 0.5)
-                myGrains->at(i)->setDirection(1.0);
-            else
-                myGrains->at(i)->setDirection(-1.0);
-        }
-
-    default:
-        break;
-    }
 }
 
 
 // return grain direction int (see enum.  currently, 0 = forward, 1 = back, 2 = random)
 int GrainCluster::getDirection()
 {
-    return myDirMode;
+    return guiParams.dirMode;
 }
 
 // return duration in ms
 float GrainCluster::getDurationMs()
 {
-    return duration;
+    return guiParams.duration;
 }
 
 
 // return number of voices in this cloud
 unsigned int GrainCluster::getNumVoices()
 {
-    return myGrains->size();
+    return numVoices;
+}
+
+
+// trigger the grains of the next block (numFrames at most CLUSTER_MAX_FRAMES)
+void GrainCluster::schedule(unsigned int numFrames)
+{
+    // a freeze asked while the last one fades out starts after it
+    if (freezeRequest > 0 && freezeState == FREEZE_OFF) {
+        freezeLength = freezeRequest;
+        freezeFade = (unsigned long)(FREEZE_FADE_SECONDS * ::samp_rate);
+        freezeRequest = 0;
+        freezePos = 0;
+        freezeState = FREEZE_CAPTURE;
+    }
+
+    // the parameters and the scene of the GUI, as one coherent set for the
+    // block
+    paramBuffer.update();
+    blockParams = &paramBuffer.read();
+
+    rendered = blockParams->active;
+    grainFrames = 0;
+    if (blockParams->active == false)
+        return;
+    blockGeometry = theScene->geometry();
+
+    if (blockParams->seedCount != rngSeedCount) {
+        rng.seed(blockParams->seed);
+        rngSeedCount = blockParams->seedCount;
+    }
+
+    // modulation, once per block, with the envelopes started again when
+    // the cloud was turned on
+    if (blockParams->activations != modActivations) {
+        mods.triggerEnvelopes();
+        modActivations = blockParams->activations;
+    }
+    mods.process(blockParams->mods, numFrames, &rng);
+    updateModulation();
+
+    // frames of the block the grains play for: up to the end of a capture,
+    // none while the loop plays (the grains left by the capture go back)
+    switch (freezeState) {
+    case FREEZE_CAPTURE:
+        grainFrames = numFrames;
+        if (grainFrames > freezeLength + freezeFade - freezePos)
+            grainFrames = freezeLength + freezeFade - freezePos;
+        break;
+    case FREEZE_ON:
+        if (myVoices.count > 0)
+            thePool->release(&myVoices);
+        break;
+    default:
+        grainFrames = numFrames;
+        break;
+    }
+
+    triggerGrains(grainFrames);
+}
+
+
+//-----------------------------------------------------------------------------
+// Trigger the grains over the first frames of the block
+//-----------------------------------------------------------------------------
+void GrainCluster::triggerGrains(unsigned int numFrames)
+{
+    // under load: longer trigger period, fewer grains at once
+    double period = modBang / (blockParams->selected ? loadDensity : loadBackgroundDensity);
+    unsigned int maxVoices = (unsigned int)ceil(numVoices * loadVoices);
+
+    // buffer variables
+    unsigned int nextFrame = 0;
+
+    // trigger each grain at the frame its bang time expires
+    while (nextFrame < numFrames) {
+
+        // check for bang
+        if (local_time >= period) {
+
+            // debug
+            // cout << "bang " << nextGrain << endl;
+            // reset local (keep the fractional part for exact density, but
+            // not more than a period, so a shorter period doesn't burst)
+            local_time = fmod(local_time - period, period);
+
+            // under load, a cloud at its reduced count of grains skips the
+            // trigger rather than cut one of its own
+            if (myVoices.count < maxVoices || maxVoices >= numVoices)
+                triggerGrain(maxVoices, nextFrame);
+        }
+
+        // frames until the next bang
+        unsigned int frameSkip = numFrames - nextFrame;
+        double untilBang = ceil(period - local_time);
+        if (untilBang < frameSkip)
+            frameSkip = (untilBang > 0) ? (unsigned int)untilBang : 0;
+
+        // advance time
+        local_time += frameSkip;
+        nextFrame += frameSkip;
+    }
+}
+
+
+//-----------------------------------------------------------------------------
+// Trigger the next grain at a frame of the block
+//-----------------------------------------------------------------------------
+void GrainCluster::triggerGrain(unsigned int maxVoices, unsigned int frame)
+{
+    // sounds under the grain, with positions and volumes
+    GrainSourceList sources;
+    placeGrain(nextGrain, &sources);
+
+    // parameters of this grain
+    GrainParams params;
+    params.duration = modDuration;
+    params.volume = modVolume;
+
+    // pitch, with its modulation
+    params.pitch = modPitch;
+
+    // direction and window (random modes draw for each grain)
+    switch (blockParams->dirMode) {
+    case BACKWARD:
+        params.direction = -1.0;
+        break;
+    case RANDOM_DIR:
+        params.direction = (rng.uniform() > 0.5f) ? 1.0 : -1.0;
+        break;
+    default:
+        params.direction = 1.0;
+        break;
+    }
+    if (blockParams->windowType == RANDOM_WIN)
+        params.window = blockParams->randomWindows[(unsigned int)(rng.uniform() * RANDOM_WIN) % RANDOM_WIN];
+    else
+        params.window = blockParams->window;
+    int interpType = blockParams->interpType;
+    params.interpType = (interpType < loadInterp) ? interpType : loadInterp;
+
+    // update spatialization/get new channel multiplier set
+    updateSpatialization();
+    for (int k = 0; k < MY_CHANNELS; k++)
+        params.chanMults[k] = channelMults[k];
+
+    // grains of a static cloud are all the same but for gain and
+    // pan, the pool renders one and replays it
+    params.memo = isStatic() ? &memo : NULL;
+
+    // trigger grain (stealing a voice if we are out of them)
+    thePool->playMe(&myVoices, maxVoices, params, sources, frame);
+
+    // queue next grain for trigger
+    nextGrain++;
+    // wrap grain idx
+    if (nextGrain >= numVoices)
+        nextGrain = 0;
 }
 
 
-// compute audio
-void GrainCluster::nextBuffer(double *accumBuff, unsigned int numFrames)
+//-----------------------------------------------------------------------------
+// Position a grain around the cloud, in the geometry of the block
+//-----------------------------------------------------------------------------
+void GrainCluster::placeGrain(unsigned int idx, GrainSourceList *sources)
 {
+    const ClusterParams &p = *blockParams;
+
+    // TODO: motion models
+    float r[4];
+    rng.fill(r, 4);
+    float xExtent = p.xRandExtent * modSpread, yExtent = p.yRandExtent * modSpread;
+    float x = p.centerX + (r[0] * xExtent - r[1] * xExtent);
+    float y = p.centerY + (r[2] * yExtent - r[3] * yExtent);
+
+    sources->count = 0;
+    for (unsigned int i = 0; i < blockGeometry->numRects; i++) {
+        double playPos, playVol;
+        if (blockGeometry->rects[i].locate(x, y, &playPos, &playVol)) {
+            // rect i plays sound i; overlaps past capacity are dropped
+            if (sources->count == GRAIN_MAX_SOURCES)
+                break;
+            GrainSource &source = sources->sources[sources->count++];
+            source.sound = i;
+            source.position = playPos;
+            source.volume = playVol;
+        }
+    }
+
+    GrainTrigger trigger;
+    trigger.cloudId = myId;
+    trigger.grain = idx;
+    trigger.x = x;
+    trigger.y = y;
+    trigger.duration = modDuration;
+    trigger.sounds = sources->count > 0;
+    theScene->postTrigger(trigger);
+}
 
-    if (addFlag == true) {
-        addFlag = false;
-        myGrains->push_back(new GrainVoice(theSounds, duration, pitch));
-        int idx = myGrains->size() - 1;
-        myGrains->at(idx)->setWindow(windowType);
-        switch (myDirMode) {
-        case FORWARD:
-            myGrains->at(idx)->setDirection(1.0);
+
+//-----------------------------------------------------------------------------
+// Render the block into the buffer of the cloud (clouds may render at the
+// same time, each only touches its own state and grains)
+//-----------------------------------------------------------------------------
+void GrainCluster::render(unsigned int numFrames)
+{
+    if (rendered == false)
+        return;
+
+    thePool->render(&myVoices, grainFrames);
+
+    unsigned int done = 0;
+    while (done < numFrames) {
+        double *out = &renderBuff[done * MY_CHANNELS];
+        unsigned int frames = numFrames - done;
+        switch (freezeState) {
+        case FREEZE_CAPTURE:
+            frames = captureGrains(out, grainFrames - done);
             break;
-        case BACKWARD:
-            myGrains->at(idx)->setDirection(-1.0);
+        case FREEZE_ON:
+            playFrozen(out, frames);
             break;
-        case RANDOM_DIR:
-            if (randf() > 0.5)
-                myGrains->at(idx)->setDirection(1.0);
-            else
-                myGrains->at(idx)->setDirection(-1.0);
+        case FREEZE_RELEASE:
+            frames = releaseFrozen(out, frames);
             break;
-
         default:
             break;
         }
+        done += frames;
+    }
+}
+
 
-        myGrains->at(idx)->setVolume(normedVol);
-        numVoices += 1;
-        setOverlap(overlapNorm);
+//-----------------------------------------------------------------------------
+// Add the block of the cloud to the output, and start the next one with the
+// fades which go past it
+//-----------------------------------------------------------------------------
+void GrainCluster::mixInto(double *accumBuff, unsigned int numFrames)
+{
+    unsigned int numSamples = numFrames * MY_CHANNELS;
+    unsigned int fadeSamples = GRAIN_STEAL_FADE * MY_CHANNELS;
+    // (a muted cloud may still get the end of a stolen grain)
+    if (rendered) {
+        for (unsigned int i = 0; i < numSamples; i++)
+            accumBuff[i] += renderBuff[i];
     }
+    memmove(renderBuff, &renderBuff[numSamples], fadeSamples * sizeof(double));
+    memset(&renderBuff[fadeSamples], 0, numSamples * sizeof(double));
+}
 
-    if (removeFlag == true) {
-        myLock->lock();
-        if (myGrains->size() > 1) {
-            if (nextGrain >= myGrains->size() - 1) {
-                nextGrain = 0;
-            }
-            myGrains->pop_back();
-            setOverlap(overlapNorm);
+
+//-----------------------------------------------------------------------------
+// Capture the rendered grains into the freeze loop
+//-----------------------------------------------------------------------------
+unsigned int GrainCluster::captureGrains(double *accumBuff, unsigned int numFrames)
+{
+    // the buffer only has this cloud in it
+    for (unsigned int i = 0; i < numFrames; i++, freezePos++) {
+        float *tail = &freezeLoop[freezePos * MY_CHANNELS];
+        double *out = &accumBuff[i * MY_CHANNELS];
+
+        if (freezePos < freezeLength) {
+            for (int k = 0; k < MY_CHANNELS; k++)
+                tail[k] = (float)out[k];
+            continue;
         }
-        removeFlag = false;
-        myLock->unlock();
-    }
-
-    if (isActive == true) {
-
-
-        // initialize play positions array
-        double playPositions[theSounds->size()];
-        double playVols[theSounds->size()];
-
-        // buffer variables
-        unsigned int nextFrame = 0;
-
-        // compute sub_buffers for reduced function calls
-        int frameSkip = numFrames / 2;
-
-
-        // fill buffer
-        for (int j = 0; j < (numFrames / (frameSkip)); j++) {
-
-            // check for bang
-            if ((local_time > bang_time) || (awaitingPlay)) {
-
-                // debug
-                // cout << "bang " << nextGrain << endl;
-                // reset local
-                if (!awaitingPlay) {
-                    local_time = 0;
-                    // clear play and volume buffs
-                    for (int i = 0; i < theSounds->size(); i++) {
-                        playPositions[i] = (double)(-1.0);
-                        playVols[i] = (double)0.0;
-                    }
-                    // TODO:  get position vector for grain with idx nextGrain from controller
-                    // udate positions vector (currently randomized)q
-                    if (myVis)
-                        myVis->getTriggerPos(nextGrain, playPositions, playVols, duration);
-                }
-
-                // get next pitch (using LFO) -  eventually generalize to an applyLFOs method (if LFO control will be exerted over multiple params)
-                if ((pitchLFOAmount > 0.0f) && (pitchLFOFreq > 0.0f)) {
-                    float nextPitch =
-                        fabs(pitch + pitchLFOAmount * sin(2 * PI * pitchLFOFreq *
-                                                          GTime::instance().sec));
-                    myGrains->at(nextGrain)->setPitch(nextPitch);
-                }
-
-
-                // update spatialization/get new channel multiplier set
-                updateSpatialization();
-                myGrains->at(nextGrain)->setChannelMultipliers(channelMults);
-
-                // trigger grain
-                awaitingPlay = myGrains->at(nextGrain)->playMe(playPositions, playVols);
-
-                // only advance if next grain is playable.  otherwise, cycle
-                // through again to wait for playback
-                if (!awaitingPlay) {
-                    // queue next grain for trigger
-                    nextGrain++;
-                    // wrap grain idx
-                    if (nextGrain >= myGrains->size())
-                        nextGrain = 0;
-                }
-                else {
-                    // debug
-                    // cout << "playback delayed "<< endl;
-                }
-            }
-            // advance time
-            local_time += frameSkip;
-
-            // sample offset (1 sample at a time for now)
-            nextFrame = j * frameSkip;
-            // iterate over all grains
-            for (int k = 0; k < myGrains->size(); k++) {
-                myGrains->at(k)->nextBuffer(accumBuff, frameSkip, nextFrame, k);
-            }
+
+        // past the loop, the head of the loop is faded in as the output
+        // fades out, so that the loop point is smooth and the output goes
+        // on into the loop without a seam
+        unsigned long j = freezePos - freezeLength;
+        float *head = &freezeLoop[j * MY_CHANNELS];
+        double theta = 0.5 * PI * (j + 0.5) / freezeFade;
+        double in = sin(theta), fade = cos(theta);
+        for (int k = 0; k < MY_CHANNELS; k++) {
+            double x = out[k];
+            double y = in * head[k] + fade * x;
+            tail[k] = (float)x;
+            head[k] = (float)y;
+            out[k] = y;
+        }
+    }
+
+    // from now on the loop plays, from where the output is (the grains go
+    // back to the pool at the next block)
+    if (freezePos == freezeLength + freezeFade) {
+        freezeState = FREEZE_ON;
+        freezePos = freezeFade;
+    }
+
+    return numFrames;
+}
+
+
+//-----------------------------------------------------------------------------
+// Play the freeze loop
+//-----------------------------------------------------------------------------
+void GrainCluster::playFrozen(double *accumBuff, unsigned int numFrames)
+{
+    // the loop replaces what grains left over from the capture played
+    for (unsigned int i = 0; i < numFrames; i++) {
+        const float *in = &freezeLoop[freezePos * MY_CHANNELS];
+        for (int k = 0; k < MY_CHANNELS; k++)
+            accumBuff[i * MY_CHANNELS + k] = in[k];
+        if (++freezePos == freezeLength)
+            freezePos = 0;
+    }
+}
+
+
+//-----------------------------------------------------------------------------
+// Fade the freeze loop out over the grains starting again
+//-----------------------------------------------------------------------------
+unsigned int GrainCluster::releaseFrozen(double *accumBuff, unsigned int numFrames)
+{
+    if (numFrames > freezeFade - fadePos)
+        numFrames = freezeFade - fadePos;
+
+    for (unsigned int i = 0; i < numFrames; i++, fadePos++) {
+        const float *in = &freezeLoop[freezePos * MY_CHANNELS];
+        double theta = 0.5 * PI * (fadePos + 0.5) / freezeFade;
+        double fade = cos(theta), grains = fadeGrains ? sin(theta) : 1.0;
+        for (int k = 0; k < MY_CHANNELS; k++) {
+            double *out = &accumBuff[i * MY_CHANNELS + k];
+            *out = grains * *out + fade * in[k];
         }
+        if (++freezePos == freezeLength)
+            freezePos = 0;
+    }
+
+    if (fadePos == freezeFade)
+        freezeState = FREEZE_OFF;
+
+    return numFrames;
+}
+
+
+//-----------------------------------------------------------------------------
+// Freeze requests
+//-----------------------------------------------------------------------------
+void GrainCluster::freeze(double seconds)
+{
+    if (freezeAsked)
+        return;
+
+    if (seconds > FREEZE_MAX_SECONDS)
+        seconds = FREEZE_MAX_SECONDS;
+    if (seconds < 2.0 * FREEZE_FADE_SECONDS)
+        seconds = 2.0 * FREEZE_FADE_SECONDS;
+
+    // the loop is allocated here once, with room for the longest one
+    if (!freezeLoop) {
+        unsigned long capacity =
+            (unsigned long)ceil((FREEZE_MAX_SECONDS + FREEZE_FADE_SECONDS) * ::samp_rate);
+        freezeLoop = new float[capacity * MY_CHANNELS];
+    }
+
+    // the command orders the allocation before the audio thread sees it
+    if (theCommands->post(CMD_FREEZE, this, floor(seconds * ::samp_rate)))
+        freezeAsked = true;
+}
+
+void GrainCluster::unfreeze()
+{
+    if (freezeAsked && theCommands->post(CMD_UNFREEZE, this))
+        freezeAsked = false;
+}
+
+bool GrainCluster::isFrozen()
+{
+    int state = freezeState.load();
+    return state == FREEZE_CAPTURE || state == FREEZE_ON;
+}
+
+void GrainCluster::startFreeze(unsigned long length)
+{
+    freezeRequest = length;
+}
+
+void GrainCluster::stopFreeze()
+{
+    freezeRequest = 0;
+    if (freezeState == FREEZE_CAPTURE && freezePos <= freezeLength)
+        freezeState = FREEZE_OFF;
+    else if (freezeState == FREEZE_CAPTURE) {
+        // part-way through the crossfade into the loop: turn it around, the
+        // loop fades out from where it plays as the grains come back
+        unsigned long j = freezePos - freezeLength;
+        freezePos = j;
+        fadePos = freezeFade - j - 1;
+        fadeGrains = true;
+        freezeState = FREEZE_RELEASE;
+    }
+    else if (freezeState == FREEZE_ON) {
+        fadePos = 0;
+        fadeGrains = false;
+        freezeState = FREEZE_RELEASE;
     }
 }
 
@@ -483,48 +892,137 @@ void GrainCluster::nextBuffer(double *accumBuff, unsigned int numFrames)
 // pitch lfo methods
 void GrainCluster::setPitchLFOFreq(float pfreq)
 {
-    pitchLFOFreq = fabs(pfreq);
+    unfreeze();
+    guiParams.mods.setLFOFreq(0, pfreq);
+    publishParams();
 }
 
 void GrainCluster::setPitchLFOAmount(float lfoamt)
 {
+    unfreeze();
     if (lfoamt < 0.0) {
         lfoamt = 0.0f;
     }
-    pitchLFOAmount = lfoamt;
+    guiParams.mods.setRoute(0, MOD_LFO1, MOD_PITCH, lfoamt);
+    publishParams();
 }
 
 float GrainCluster::getPitchLFOFreq()
 {
-    return pitchLFOFreq;
+    return guiParams.mods.getLFOFreq(0);
 }
 
 float GrainCluster::getPitchLFOAmount()
 {
-    return pitchLFOAmount;
+    return guiParams.mods.getRoute(0).depth;
 }
 
 
 // spatialization methods
 void GrainCluster::setSpatialMode(int theMode, int channelNumber = -1)
 {
-    spatialMode = theMode % 3;
-    if (spatialMode < 0) {
-        spatialMode = 2;
+    unfreeze();
+    guiParams.spatialMode = theMode % 3;
+    if (guiParams.spatialMode < 0) {
+        guiParams.spatialMode = 2;
     }
     // for positioning in a single audio channel. - not used currently
     // eventually swap out for azimuth instead of single channel
     if (channelNumber >= 0)
-        channelLocation = channelNumber;
+        guiParams.channelLocation = channelNumber;
+    publishParams();
 }
 
 int GrainCluster::getSpatialMode()
 {
-    return spatialMode;
+    return guiParams.spatialMode;
 }
 int GrainCluster::getSpatialChannel()
 {
-    return channelLocation;
+    return guiParams.channelLocation;
+}
+
+// parameters with their modulation, for this block
+void GrainCluster::updateModulation()
+{
+    const ClusterParams &p = *blockParams;
+
+    // the modulation keeps to the floor of setDurationMs
+    modDuration = fmax(1.0, p.duration * pow(2.0, mods.value(MOD_DURATION)));
+
+    float num = (float)numVoices;
+    double theOverlap = exp(log(num) * p.overlapNorm);
+    if (mods.value(MOD_OVERLAP) != 0.0) {
+        double norm = p.overlapNorm + mods.value(MOD_OVERLAP);
+        norm = (norm < 0.0) ? 0.0 : ((norm > 1.0) ? 1.0 : norm);
+        theOverlap = exp(log((double)numVoices) * norm);
+    }
+    // at most one grain per frame
+    modBang = fmax(1.0, modDuration * ::samp_rate * (double)0.001 / theOverlap);
+
+    modVolume = p.normedVol;
+    if (mods.value(MOD_VOLUME) != 0.0)
+        modVolume = pow(10.0, (p.volumeDb + mods.value(MOD_VOLUME)) * 0.05);
+
+    modSpread = fmax(0.0, 1.0 + mods.value(MOD_SPREAD));
+    // the modulation can cross zero, keep the floor of setPitch
+    modPitch = fmax(0.0001, fabs(p.pitch + mods.value(MOD_PITCH)));
+}
+
+// modulation matrix
+void GrainCluster::setLFO(unsigned int idx, int shape, double freq)
+{
+    unfreeze();
+    guiParams.mods.setLFO(idx, shape, freq);
+    publishParams();
+}
+
+void GrainCluster::setModEnvelope(unsigned int idx, double attack, double decay)
+{
+    unfreeze();
+    guiParams.mods.setEnvelope(idx, attack, decay);
+    publishParams();
+}
+
+void GrainCluster::setModRoute(unsigned int slot, int source, int target, double depth)
+{
+    unfreeze();
+    guiParams.mods.setRoute(slot, source, target, depth);
+    publishParams();
+}
+
+ModRoute GrainCluster::getModRoute(unsigned int slot)
+{
+    return guiParams.mods.getRoute(slot);
+}
+
+// limits set by the load governor
+void GrainCluster::setLoadLimits(int maxInterp, double voiceScale, double densityScale,
+                                 double backgroundDensityScale)
+{
+    loadInterp = maxInterp;
+    loadVoices = voiceScale;
+    loadDensity = densityScale;
+    loadBackgroundDensity = backgroundDensityScale;
+}
+
+// seed of the random numbers of the grains
+void GrainCluster::setSeed(uint64_t theSeed)
+{
+    guiParams.seed = theSeed;
+    guiParams.seedCount++;
+    publishParams();
+}
+
+// grains which only differ by gain and pan
+bool GrainCluster::isStatic()
+{
+    if (blockParams->xRandExtent != 0.0f || blockParams->yRandExtent != 0.0f)
+        return false;
+    if (blockParams->dirMode == RANDOM_DIR || blockParams->windowType == RANDOM_WIN)
+        return false;
+    return !blockParams->mods.modulates(MOD_PITCH) &&
+           !blockParams->mods.modulates(MOD_DURATION);
 }
 
 // spatialization logic
@@ -532,7 +1030,7 @@ void GrainCluster::updateSpatialization()
 {
 
     // currently assumes orientation L: 0,2,4,...  R: 1,3,5, etc (interleaved)
-    switch (spatialMode) {
+    switch (blockParams->spatialMode) {
     case UNITY:
         for (int i = 0; i < MY_CHANNELS; i++) {
             channelMults[i] = 0.999f;
@@ -707,30 +1205,13 @@ void GrainClusterVis::draw()
 }
 
 
-// get trigger position/volume relative to sound rects for single grain voice
-void GrainClusterVis::getTriggerPos(unsigned int idx, double *playPos,
-                                    double *playVol, float theDur)
-{
-    bool trigger = false;
-    SoundRect *theRect = NULL;
-    if (idx < myGrainsV->size()) {
-        GrainVis *theGrain = myGrainsV->at(idx);
-        // TODO: motion models
-        // updateGrainPosition(idx,gcX + randf()*50.0 + randf()*(-50.0),gcY + randf()*50.0 + randf()*(-50.0));
-        updateGrainPosition(idx, gcX + (randf() * xRandExtent - randf() * xRandExtent),
-                            gcY + (randf() * yRandExtent - randf() * yRandExtent));
-        for (int i = 0; i < theLandscape->size(); i++) {
-            theRect = theLandscape->at(i);
-            bool tempTrig = false;
-            tempTrig = theRect->getNormedPosition(playPos, playVol, theGrain->getX(),
-                                                  theGrain->getY(), i);
-            if (tempTrig == true)
-                trigger = true;
-            // cout << "playvol: " << *playPos << ", playpos: " << *playVol << endl;
-        }
-        if (trigger == true) {
-            theGrain->trigger(theDur);
-        }
+// show a grain where the audio thread placed it
+void GrainClusterVis::showGrain(unsigned int idx, float x, float y, float dur, bool sounds)
+{
+    if (idx < numGrains) {
+        updateGrainPosition(idx, x, y);
+        if (sounds == true)
+            myGrainsV->at(idx)->trigger(dur);
     }
 }
 
@@ -42,8 +42,12 @@
 #include "GrainVoice.h"
 #include "theglobals.h"
 #include "Window.h"
-#include "Thread.h"
 #include "SoundRect.h"
+#include "Random.h"
+#include "ModMatrix.h"
+#include "TripleBuffer.h"
+#include "Scene.h"
+#include <atomic>
 
 // direction modes
 enum { FORWARD, BACKWARD, RANDOM_DIR };
@@ -55,12 +59,68 @@ enum {
     AROUND
 };  // eventually include channel list specification and VBAP?
 
+// freeze states: capturing the output, playing the loop, fading it out
+enum {
+    FREEZE_OFF,
+    FREEZE_CAPTURE,
+    FREEZE_ON,
+    FREEZE_RELEASE
+};
+
+// seconds looped by a freeze (by default and at most), and length of the
+// crossfade at the loop point and when the grains come back
+static const double FREEZE_SECONDS = 8.0;
+static const double FREEZE_MAX_SECONDS = 30.0;
+static const double FREEZE_FADE_SECONDS = 0.5;
+
+// most frames of a block (the audio callback splits longer ones)
+enum { CLUSTER_MAX_FRAMES = 4096 };
+
 using namespace std;
 
 
 // forward declarations
 class GrainCluster;
 class GrainClusterVis;
+class CommandQueue;
+
+
+// parameters of a cluster set by the GUI, which the audio thread takes as a
+// whole once per block
+struct ClusterParams {
+    float duration;  // ms
+    float overlapNorm;  // 0 to 1
+    float pitch;
+    float volumeDb, normedVol;
+    int dirMode, windowType, interpType;
+    double windowParam;
+    unsigned int windowLength;
+    int spatialMode, channelLocation;
+
+    // position of the cloud, and how far from it the grains go
+    float centerX, centerY;
+    float xRandExtent, yRandExtent;
+
+    // window tables, looked up when the window changes: the one of the
+    // window type, or the candidates of RANDOM_WIN
+    const WindowTable *window;
+    const WindowTable *randomWindows[RANDOM_WIN];
+
+    // LFOs, envelopes and routes of the modulation
+    ModSettings mods;
+
+    // on/off state, and count of the times it was turned on (which starts
+    // the envelopes)
+    bool active;
+    unsigned int activations;
+
+    // seed of the random numbers of the grains, taken when the count changes
+    uint64_t seed;
+    unsigned int seedCount;
+
+    // whether the cloud is the one being edited
+    bool selected;
+};
 
 // ids
 static unsigned int clusterId = 0;
@@ -74,10 +134,16 @@ public:
     virtual ~GrainCluster();
 
     // constructor
-    GrainCluster(vector<AudioFile *> *soundSet, float theNumVoices);
+    GrainCluster(vector<AudioFile *> *soundSet, GrainVoicePool *pool, Scene *scene,
+                 CommandQueue *commands, float theNumVoices);
 
-    // compute next buffer of audio (accumulate from grains)
-    void nextBuffer(double *accumBuff, unsigned int numFrames);
+    // compute the next block of audio, in three steps: trigger the grains
+    // (clouds one after the other), render them into the buffer of the
+    // cloud (clouds possibly at the same time, see GrainVoicePool), then add
+    // the buffer to the output
+    void schedule(unsigned int numFrames);
+    void render(unsigned int numFrames);
+    void mixInto(double *accumBuff, unsigned int numFrames);
 
     // CLUSTER PARAMETER accessors/mutators
     // set duration for all grains
@@ -103,13 +169,27 @@ public:
     void setDirection(int dirMode);
     int getDirection();
 
-    // add/remove grain voice
+    // add/remove grain voice (audio thread, the GUI posts CMD_ADD_GRAIN and
+    // CMD_REMOVE_GRAIN)
     void addGrain();
     void removeGrain();
 
+    // stop the grains of a cloud being removed (audio thread)
+    void releaseVoices();
+
     // set window type
     void setWindowType(int windowType);
     int getWindowType();
+    // parameter of the window shape (negative for the default, see Window.h)
+    void setWindowParam(double theParam);
+    double getWindowParam();
+    // number of points of the window tables (a power of two, see Window.h)
+    void setWindowLength(unsigned int theLength);
+    unsigned int getWindowLength();
+
+    // interpolation quality of the sounds (see GrainKernel.h)
+    void setInterpolation(int theInterp);
+    int getInterpolation();
 
 
     // spatialization methods (see enum for theMode.  channel number is optional and has default arg);
@@ -128,31 +208,90 @@ public:
     // register visualization
     void registerVis(GrainClusterVis *myVis);
 
+    // take the position and spread of the cloud from the visualization,
+    // after it moved or changed
+    void updateGeometry();
+
     // turn on/off
     void toggleActive();
     bool getActiveState();
 
+    // whether the cloud is the one being edited, which keeps its density
+    // under load
+    void setSelected(bool selected);
+
+    // modulation matrix (see ModMatrix.h).  the pitch LFO above is LFO 1
+    // on route 0.
+    void setLFO(unsigned int idx, int shape, double freq);
+    void setModEnvelope(unsigned int idx, double attack, double decay);
+    void setModRoute(unsigned int slot, int source, int target, double depth);
+    ModRoute getModRoute(unsigned int slot);
+
+    // restart the random numbers of the grains (seeded with the id by default)
+    void setSeed(uint64_t theSeed);
+
+    // quality under load (see LoadGovernor.h): best interpolation, and
+    // fractions of the grains played at once and of the trigger rate, when
+    // the cloud is selected and when it plays in the background
+    void setLoadLimits(int maxInterp, double voiceScale, double densityScale,
+                       double backgroundDensityScale);
+
+    // freeze: loop the next seconds of output and stop the grains, until
+    // unfreeze is called (which the parameter setters do).  the requests
+    // go to the audio thread as CMD_FREEZE and CMD_UNFREEZE.
+    void freeze(double seconds = FREEZE_SECONDS);
+    void unfreeze();
+    bool isFrozen();
+
+    // carry out the freeze requests (audio thread)
+    void startFreeze(unsigned long length);
+    void stopFreeze();
+
 
     // return number of voices
     unsigned int getNumVoices();
 
 
 protected:
-    // update internal trigger point
-    void updateBangTime();
+    // hand the parameters over to the audio thread
+    void publishParams();
+
+    // look up the window tables of a window setting and publish it, letting
+    // go of the old tables.  false if they can not be generated, and the
+    // current window is kept.
+    bool findWindows(int windowType, double param, unsigned int length);
 
     // spatialization - get new channel multiplier buffer to pass to grain voice instance
     void updateSpatialization();
 
+    // parameters with their modulation, for the current block
+    void updateModulation();
+
+    // trigger grains over the first frames of the block
+    void triggerGrains(unsigned int numFrames);
+
+    // trigger the next grain at a frame of the block, as one of maxVoices
+    void triggerGrain(unsigned int maxVoices, unsigned int frame);
+
+    // position a grain and list the rectangles under it (up to
+    // GRAIN_MAX_SOURCES), and report it to the GUI
+    void placeGrain(unsigned int idx, GrainSourceList *sources);
+
+    // capture the grains / play the loop / fade it out, return the number
+    // of frames done
+    unsigned int captureGrains(double *accumBuff, unsigned int numFrames);
+    void playFrozen(double *accumBuff, unsigned int numFrames);
+    unsigned int releaseFrozen(double *accumBuff, unsigned int numFrames);
+
+    // whether all grains read the same span the same way (no position
+    // spread, no random direction or window, no pitch LFO)
+    bool isStatic();
+
 private:
     unsigned int myId;  // unique id
 
-    bool isActive;  // on/off state
-    bool awaitingPlay;  // triggered but not ready to play?
-    bool addFlag, removeFlag;  // add/remove requests submitted?
-    unsigned long local_time;  // internal clock
+    double local_time;  // internal clock (samples)
     double startTime;  // instantiation time
-    double bang_time;  // trigger time for next grain
     unsigned int nextGrain;  // grain voice index
 
     // spatialization vars
@@ -160,30 +299,72 @@ private:
     int stereoSide;
     int side;
 
-
-    // thread safety
-    Mutex *myLock;
-
     // registered visualization
     GrainClusterVis *myVis;
 
     // spatialization
     double *channelMults;
-    int spatialMode;
-    int channelLocation;
 
-    // volume
-    float volumeDb, normedVol;
+    // pool of the grain voices, and voices borrowed from it
+    GrainVoicePool *thePool;
+    GrainVoiceList myVoices;
 
-    // vector of grains
-    vector<GrainVoice *> *myGrains;
+    // block the grains render into (CLUSTER_MAX_FRAMES, and the fades of
+    // the stolen grains past it), frames of it they play for, and whether
+    // the cloud plays in this block
+    double *renderBuff;
+    unsigned int grainFrames;
+    bool rendered;
 
-    // number of grains in this cluster
+    // number of grains in this cluster (most playing at once)
     unsigned int numVoices;
 
-    // cluster params
-    float overlap, overlapNorm, pitch, duration, pitchLFOFreq, pitchLFOAmount;
-    int myDirMode, windowType;
+    // cluster params: as the GUI last set them, published through a triple
+    // buffer, and the ones of the block being triggered
+    ClusterParams guiParams;
+    TripleBuffer<ClusterParams> paramBuffer;
+    const ClusterParams *blockParams;
+
+    // requests to the audio thread
+    CommandQueue *theCommands;
+
+    // rectangles the grains play, and their geometry for the block
+    Scene *theScene;
+    const SceneGeometry *blockGeometry;
+
+    // random numbers of the audio thread, and the seed setting it follows
+    Random rng;
+    unsigned int rngSeedCount;
+
+    // modulation, the activation it last started the envelopes for, and the
+    // parameters it gives for the current block
+    ModMatrix mods;
+    unsigned int modActivations;
+    double modDuration, modBang, modPitch, modVolume, modSpread;
+
+    // limits of the load governor
+    int loadInterp;
+    double loadVoices, loadDensity, loadBackgroundDensity;
+
+    // grain replayed while the cloud is static
+    GrainMemo memo;
+
+    // whether the GUI asked for a freeze, and the length of the loop asked
+    // for which the audio thread did not start yet (0 if none)
+    bool freezeAsked;
+    unsigned long freezeRequest;
+
+    // freeze state (written by the audio thread only), and the loop
+    // (MY_CHANNELS interleaved, the crossfade is captured past its end,
+    // allocated by the GUI before its first CMD_FREEZE).  freezePos is the
+    // frame being captured or played, fadePos the one of the fade out, and
+    // fadeGrains whether the grains fade back in with it (after a capture
+    // stopped during its crossfade).
+    std::atomic<int> freezeState;
+    float *freezeLoop;
+    unsigned long freezeLength, freezeFade;
+    unsigned long freezePos, fadePos;
+    bool fadeGrains;
 
     // audio files
     vector<AudioFile *> *theSounds;
@@ -201,8 +382,8 @@ public:
 
     // render
     void draw();
-    // get playback position in registered rectangles and return to grain cloud
-    void getTriggerPos(unsigned int idx, double *playPos, double *playVols, float dur);
+    // show a grain where the audio thread placed it (see GrainTrigger)
+    void showGrain(unsigned int idx, float x, float y, float dur, bool sounds);
     // move grains
     void updateCloudPosition(float x, float y);
     void updateGrainPosition(int idx, float x, float y);
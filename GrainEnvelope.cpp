@@ -0,0 +1,154 @@
+//------------------------------------------------------------------------------
+// FRONTIÈRES:  An interactive granular sampler.
+//------------------------------------------------------------------------------
+// More information is available at
+//     http::/ccrma.stanford.edu/~carlsonc/256a/Borderlands/index.html
+//
+//
+// Copyright (C) 2018  Jean Pierre Cimalando
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 3.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+//
+//  GrainEnvelope.cpp
+//  Frontières
+//
+
+#include "GrainEnvelope.h"
+
+
+//-----------------------------------------------------------------------------
+// Analytic envelopes
+//-----------------------------------------------------------------------------
+int grainEnvelopeAnalytic(const WindowTable *window, GrainPhase winInc,
+                          GrainEnvelopeState *state)
+{
+    // window points advanced by each frame
+    double rate = winInc * (1.0 / 4294967296.0);
+
+    switch (window->type) {
+    case HANNING: {
+        // 0.5 * (1 - cos(2 pi i / length)), see Window::hanning
+        double w = 2 * M_PI * rate / window->length;
+        state->y0 = 1.0;
+        state->y1 = cos(w);
+        state->k = 2.0 * cos(w);
+        return ENVELOPE_HANN;
+    }
+    case EXPDEC:
+    case REXPDEC: {
+        // exp(-i / tau), forward or reversed, see Window::expdec
+        double tau = window->length * WINDOW_EXP_TAU;
+        if (window->type == EXPDEC) {
+            state->y0 = 1.0;
+            state->k = exp(-rate / tau);
+        }
+        else {
+            state->y0 = exp(-(window->length - 1.0) / tau);
+            state->k = exp(rate / tau);
+        }
+        state->y1 = 0.0;
+        return ENVELOPE_EXP;
+    }
+    default:
+        return ENVELOPE_TABLE;
+    }
+}
+
+void grainHannRun(GrainEnvelopeState *state, double *env, unsigned int n)
+{
+    double y0 = state->y0, y1 = state->y1;
+    const double k = state->k;
+    for (unsigned int i = 0; i < n; i++) {
+        env[i] = 0.5 - 0.5 * y0;
+        double y = k * y0 - y1;
+        y1 = y0;
+        y0 = y;
+    }
+    state->y0 = y0;
+    state->y1 = y1;
+}
+
+void grainExpRun(GrainEnvelopeState *state, double *env, unsigned int n)
+{
+    double y = state->y0;
+    const double k = state->k;
+    for (unsigned int i = 0; i < n; i++) {
+        env[i] = y;
+        y *= k;
+    }
+    state->y0 = y;
+}
+
+
+//-----------------------------------------------------------------------------
+// Envelope cache
+//-----------------------------------------------------------------------------
+GrainEnvelopeCache::~GrainEnvelopeCache()
+{
+    delete[] data;
+}
+
+GrainEnvelopeCache::GrainEnvelopeCache()
+{
+    for (unsigned int i = 0; i < ENVELOPE_CACHE_SLOTS; i++) {
+        keyWindow[i] = 0;
+        keyInc[i] = 0;
+        refs[i] = 0;
+        lastUse[i] = 0;
+    }
+    useCount = 0;
+    data = new double[(unsigned long)ENVELOPE_CACHE_SLOTS * ENVELOPE_CACHE_FRAMES];
+}
+
+int GrainEnvelopeCache::acquire(const WindowTable *window, GrainPhase winInc,
+                                unsigned long frames)
+{
+    if (frames > ENVELOPE_CACHE_FRAMES)
+        return -1;
+
+    // cached already, or the free slot used the longest ago
+    int slot = -1;
+    for (int i = 0; i < ENVELOPE_CACHE_SLOTS; i++) {
+        if (keyWindow[i] == window->serial && keyInc[i] == winInc) {
+            slot = i;
+            break;
+        }
+        if (refs[i] == 0 && (slot == -1 || lastUse[i] < lastUse[slot]))
+            slot = i;
+    }
+    if (slot == -1)
+        return -1;
+
+    if (keyWindow[slot] != window->serial || keyInc[slot] != winInc) {
+        grainWindowRun(window->data, 0, winInc, &data[slot * ENVELOPE_CACHE_FRAMES],
+                       (unsigned int)frames);
+        keyWindow[slot] = window->serial;
+        keyInc[slot] = winInc;
+    }
+
+    refs[slot]++;
+    lastUse[slot] = ++useCount;
+    return slot;
+}
+
+void GrainEnvelopeCache::release(int slot)
+{
+    refs[slot]--;
+}
+
+const double *GrainEnvelopeCache::envelope(int slot) const
+{
+    return &data[(unsigned long)slot * ENVELOPE_CACHE_FRAMES];
+}
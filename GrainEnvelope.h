@@ -0,0 +1,104 @@
+//------------------------------------------------------------------------------
+// FRONTIÈRES:  An interactive granular sampler.
+//------------------------------------------------------------------------------
+// More information is available at
+//     http::/ccrma.stanford.edu/~carlsonc/256a/Borderlands/index.html
+//
+//
+// Copyright (C) 2018  Jean Pierre Cimalando
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 3.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+//
+//  GrainEnvelope.h
+//  Frontières
+//
+//  Envelopes of the grains, produced without reading the window table at
+//  every frame: the shapes which have a closed form are computed by
+//  recurrence, and the others are rendered once per (window, duration)
+//  into a cache shared by the grains.
+//
+
+#ifndef GRAINENVELOPE_H
+#define GRAINENVELOPE_H
+
+#include "GrainKernel.h"
+#include "Window.h"
+
+// ways a grain gets its envelope
+enum {
+    ENVELOPE_TABLE,   // interpolated reads of the window table
+    ENVELOPE_CACHED,  // pre-rendered envelope of the cache
+    ENVELOPE_HANN,    // cosine recurrence
+    ENVELOPE_EXP      // geometric progression
+};
+
+// number of cached envelopes, and longest one (in frames)
+enum { ENVELOPE_CACHE_SLOTS = 8, ENVELOPE_CACHE_FRAMES = 8192 };
+
+// state of an analytic envelope, carried from run to run
+struct GrainEnvelopeState {
+    // hann: cosines at the current frame and at the previous one.
+    // exp: value at the current frame (y0 only).
+    double y0, y1;
+    // hann: twice the cosine of the phase increment.
+    // exp: ratio of two successive frames.
+    double k;
+};
+
+// set up the analytic envelope of a window read with an increment.
+// returns ENVELOPE_HANN or ENVELOPE_EXP, or ENVELOPE_TABLE if the shape
+// has no closed form.
+int grainEnvelopeAnalytic(const WindowTable *window, GrainPhase winInc,
+                          GrainEnvelopeState *state);
+
+// compute the next n frames of an analytic envelope
+void grainHannRun(GrainEnvelopeState *state, double *env, unsigned int n);
+void grainExpRun(GrainEnvelopeState *state, double *env, unsigned int n);
+
+
+// pre-rendered envelopes, keyed by window and increment (so by duration).
+// storage is allocated at construction, slots are recycled when no grain
+// refers to them anymore.
+class GrainEnvelopeCache {
+
+public:
+    // destructor
+    ~GrainEnvelopeCache();
+
+    // constructor
+    GrainEnvelopeCache();
+
+    // get the slot of an envelope, rendering it if it isn't cached, and hold
+    // a reference to it.  returns -1 if the envelope is longer than
+    // ENVELOPE_CACHE_FRAMES or if all slots are in use.
+    int acquire(const WindowTable *window, GrainPhase winInc, unsigned long frames);
+    // drop a reference
+    void release(int slot);
+
+    // envelope of a slot
+    const double *envelope(int slot) const;
+
+private:
+    // serial of the window (0 if none), since its slot may take another one
+    unsigned long keyWindow[ENVELOPE_CACHE_SLOTS];
+    GrainPhase keyInc[ENVELOPE_CACHE_SLOTS];
+    // number of grains reading a slot, and time of its last acquisition
+    unsigned int refs[ENVELOPE_CACHE_SLOTS];
+    unsigned long lastUse[ENVELOPE_CACHE_SLOTS];
+    unsigned long useCount;
+    double *data;
+};
+
+#endif
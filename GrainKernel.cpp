@@ -0,0 +1,580 @@
+//------------------------------------------------------------------------------
+// FRONTIÈRES:  An interactive granular sampler.
+//------------------------------------------------------------------------------
+// More information is available at
+//     http::/ccrma.stanford.edu/~carlsonc/256a/Borderlands/index.html
+//
+//
+// Copyright (C) 2018  Jean Pierre Cimalando
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 3.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+//
+//  GrainKernel.cpp
+//  Frontières
+//
+
+#include "GrainKernel.h"
+#include "AudioFileSet.h"
+#include <math.h>
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#if defined(__AVX__)
+#include <immintrin.h>
+#endif
+
+
+//-----------------------------------------------------------------------------
+// Run lengths
+//-----------------------------------------------------------------------------
+unsigned int grainWindowRunLength(GrainPhase reader, GrainPhase inc,
+                                  unsigned int length, unsigned int n)
+{
+    GrainPhase end = (GrainPhase)(length - 1) << GRAIN_PHASE_BITS;
+    if (reader > end)
+        return 0;
+    uint64_t count = (uint64_t)(end - reader) / inc + 1;
+    return (count < n) ? (unsigned int)count : n;
+}
+
+unsigned int grainSourceRunLength(GrainPhase pos, GrainPhase inc,
+                                  unsigned long frames, unsigned int n)
+{
+    // the left bound of interpolation must stay below the last frame (the
+    // guard frames of the sound make up for the width of the interpolator)
+    GrainPhase limit = (GrainPhase)(frames - 1) << GRAIN_PHASE_BITS;
+    if (!(pos > 0) || !(pos < limit))
+        return 0;
+    uint64_t dist = (inc > 0) ? (limit - pos) : pos;
+    uint64_t step = (inc > 0) ? inc : -inc;
+    uint64_t count = (dist + step - 1) / step;
+    return (count < n) ? (unsigned int)count : n;
+}
+
+
+//-----------------------------------------------------------------------------
+// Phase helpers
+//-----------------------------------------------------------------------------
+// frame index of a phase
+static inline unsigned long phaseIndex(GrainPhase p)
+{
+    return (unsigned long)(p >> GRAIN_PHASE_BITS);
+}
+
+// interpolation coefficient of a phase.  only the upper 31 bits of the
+// fraction are kept, so that it converts as a signed int in the vector code.
+static inline int32_t phaseFracBits(GrainPhase p)
+{
+    return (int32_t)((uint32_t)p >> 1);
+}
+
+static inline double phaseFrac(GrainPhase p)
+{
+    return phaseFracBits(p) * (1.0 / 2147483648.0);
+}
+
+#if defined(__SSE2__)
+// two consecutive samples, of any storage format, as doubles
+static inline __m128d load2(const double *x)
+{
+    return _mm_loadu_pd(x);
+}
+
+static inline __m128d load2(const float *x)
+{
+    return _mm_cvtps_pd(_mm_castsi128_ps(_mm_loadl_epi64((const __m128i *)x)));
+}
+
+static inline __m128d load2(const int16_t *x)
+{
+    int32_t pair;
+    memcpy(&pair, x, sizeof(pair));
+    __m128i w = _mm_unpacklo_epi16(_mm_cvtsi32_si128(pair), _mm_cvtsi32_si128(pair));
+    return _mm_cvtepi32_pd(_mm_srai_epi32(w, 16));
+}
+
+// interpolation coefficients of two phases
+static inline __m128d laneFracs(GrainPhase p0, GrainPhase p1)
+{
+    __m128i fr = _mm_set_epi32(0, 0, phaseFracBits(p1), phaseFracBits(p0));
+    return _mm_mul_pd(_mm_cvtepi32_pd(fr), _mm_set1_pd(1.0 / 2147483648.0));
+}
+#endif
+
+#if defined(__AVX__)
+// two pairs of consecutive samples, in the low and high halves
+template <class T> static inline __m256d load2x2(const T *x0, const T *x1)
+{
+    return _mm256_insertf128_pd(_mm256_castpd128_pd256(load2(x0)), load2(x1), 1);
+}
+
+// the first lane of x repeated in the low half, the second in the high half
+static inline __m256d spread2(__m128d x)
+{
+    return _mm256_insertf128_pd(_mm256_castpd128_pd256(_mm_unpacklo_pd(x, x)),
+                                _mm_unpackhi_pd(x, x), 1);
+}
+#endif
+
+
+//-----------------------------------------------------------------------------
+// Window
+//-----------------------------------------------------------------------------
+void grainWindowRun(const float *window, GrainPhase reader, GrainPhase inc,
+                    double *env, unsigned int n)
+{
+    unsigned int i = 0;
+    GrainPhase p = reader;
+
+#if defined(__SSE2__)
+    for (; i + 2 <= n; i += 2) {
+        GrainPhase p1 = p + inc;
+        __m128d nu = laneFracs(p, p1);
+        __m128d w0 = load2(&window[phaseIndex(p)]);
+        __m128d w1 = load2(&window[phaseIndex(p1)]);
+        __m128d a = _mm_unpacklo_pd(w0, w1);
+        __m128d b = _mm_unpackhi_pd(w0, w1);
+        _mm_storeu_pd(&env[i], _mm_add_pd(a, _mm_mul_pd(nu, _mm_sub_pd(b, a))));
+        p = p1 + inc;
+    }
+#endif
+
+    for (; i < n; i++, p += inc) {
+        unsigned long idx = phaseIndex(p);
+        double nu = phaseFrac(p);
+        env[i] = window[idx] + nu * ((double)window[idx + 1] - window[idx]);
+    }
+}
+
+
+//-----------------------------------------------------------------------------
+// Interpolators
+//-----------------------------------------------------------------------------
+// 2-point linear interpolation
+struct LinearInterp {
+    // value at frame f + nu, for samples spaced by stride
+    template <class T> static inline double read(const T *f, unsigned int stride, double nu)
+    {
+        return f[0] + nu * (f[stride] - f[0]);
+    }
+#if defined(__SSE2__)
+    // mono frames f0 + nu[0] and f1 + nu[1]
+    template <class T> static inline __m128d mono2(const T *f0, const T *f1, __m128d nu)
+    {
+        __m128d p0 = load2(f0);
+        __m128d p1 = load2(f1);
+        __m128d a = _mm_unpacklo_pd(p0, p1);
+        __m128d b = _mm_unpackhi_pd(p0, p1);
+        return _mm_add_pd(a, _mm_mul_pd(nu, _mm_sub_pd(b, a)));
+    }
+    // L/R pair of the stereo frame f + nu (nu in both lanes)
+    template <class T> static inline __m128d stereo1(const T *f, __m128d nu)
+    {
+        __m128d a = load2(f);
+        __m128d b = load2(f + 2);
+        return _mm_add_pd(a, _mm_mul_pd(nu, _mm_sub_pd(b, a)));
+    }
+#endif
+#if defined(__AVX__)
+    // L/R pairs of the stereo frames f0 + nu[0] and f1 + nu[1]
+    template <class T> static inline __m256d stereo2(const T *f0, const T *f1, __m128d nu)
+    {
+        __m256d a = load2x2(f0, f1);
+        __m256d b = load2x2(f0 + 2, f1 + 2);
+        return _mm256_add_pd(a, _mm256_mul_pd(spread2(nu), _mm256_sub_pd(b, a)));
+    }
+#endif
+};
+
+
+// 4-point, 3rd-order Hermite interpolation
+struct HermiteInterp {
+    template <class T> static inline double read(const T *f, unsigned int stride, double nu)
+    {
+        long d = stride;
+        double xm1 = f[-d], x0 = f[0], x1 = f[d], x2 = f[2 * d];
+        double c1 = 0.5 * (x1 - xm1);
+        double c2 = xm1 - 2.5 * x0 + 2.0 * x1 - 0.5 * x2;
+        double c3 = 0.5 * (x2 - xm1) + 1.5 * (x0 - x1);
+        return ((c3 * nu + c2) * nu + c1) * nu + x0;
+    }
+#if defined(__SSE2__)
+    static inline __m128d curve(__m128d xm1, __m128d x0, __m128d x1, __m128d x2,
+                                __m128d nu)
+    {
+        const __m128d half = _mm_set1_pd(0.5);
+        __m128d c1 = _mm_mul_pd(half, _mm_sub_pd(x1, xm1));
+        __m128d c2 = _mm_sub_pd(
+            _mm_add_pd(xm1, _mm_add_pd(x1, x1)),
+            _mm_add_pd(_mm_mul_pd(_mm_set1_pd(2.5), x0), _mm_mul_pd(half, x2)));
+        __m128d c3 = _mm_add_pd(_mm_mul_pd(half, _mm_sub_pd(x2, xm1)),
+                                _mm_mul_pd(_mm_set1_pd(1.5), _mm_sub_pd(x0, x1)));
+        __m128d y = _mm_add_pd(_mm_mul_pd(c3, nu), c2);
+        y = _mm_add_pd(_mm_mul_pd(y, nu), c1);
+        return _mm_add_pd(_mm_mul_pd(y, nu), x0);
+    }
+    template <class T> static inline __m128d mono2(const T *f0, const T *f1, __m128d nu)
+    {
+        __m128d a0 = load2(f0 - 1), a1 = load2(f0 + 1);
+        __m128d b0 = load2(f1 - 1), b1 = load2(f1 + 1);
+        return curve(_mm_unpacklo_pd(a0, b0), _mm_unpackhi_pd(a0, b0),
+                     _mm_unpacklo_pd(a1, b1), _mm_unpackhi_pd(a1, b1), nu);
+    }
+    template <class T> static inline __m128d stereo1(const T *f, __m128d nu)
+    {
+        return curve(load2(f - 2), load2(f), load2(f + 2),
+                     load2(f + 4), nu);
+    }
+#endif
+#if defined(__AVX__)
+    static inline __m256d curve(__m256d xm1, __m256d x0, __m256d x1, __m256d x2,
+                                __m256d nu)
+    {
+        const __m256d half = _mm256_set1_pd(0.5);
+        __m256d c1 = _mm256_mul_pd(half, _mm256_sub_pd(x1, xm1));
+        __m256d c2 = _mm256_sub_pd(
+            _mm256_add_pd(xm1, _mm256_add_pd(x1, x1)),
+            _mm256_add_pd(_mm256_mul_pd(_mm256_set1_pd(2.5), x0),
+                          _mm256_mul_pd(half, x2)));
+        __m256d c3 = _mm256_add_pd(_mm256_mul_pd(half, _mm256_sub_pd(x2, xm1)),
+                                   _mm256_mul_pd(_mm256_set1_pd(1.5), _mm256_sub_pd(x0, x1)));
+        __m256d y = _mm256_add_pd(_mm256_mul_pd(c3, nu), c2);
+        y = _mm256_add_pd(_mm256_mul_pd(y, nu), c1);
+        return _mm256_add_pd(_mm256_mul_pd(y, nu), x0);
+    }
+    template <class T> static inline __m256d stereo2(const T *f0, const T *f1, __m128d nu)
+    {
+        return curve(load2x2(f0 - 2, f1 - 2), load2x2(f0, f1),
+                     load2x2(f0 + 2, f1 + 2), load2x2(f0 + 4, f1 + 4), spread2(nu));
+    }
+#endif
+};
+
+// polyphase windowed-sinc interpolation, over frames -3 to +4.  the filter
+// of a fractional position is interpolated between the two nearest phases.
+enum { SINC_TAPS = 8, SINC_PHASES = 256 };
+
+struct SincTable {
+    // SINC_PHASES + 1 rows of SINC_TAPS coefficients, rows aligned for
+    // the vector loads
+    alignas(16) double coefs[(SINC_PHASES + 1) * SINC_TAPS];
+
+    SincTable()
+    {
+        // cutoff a little below nyquist, blackman window over the taps
+        const double fc = 0.9;
+        const double half = SINC_TAPS / 2;
+        for (int p = 0; p <= SINC_PHASES; p++) {
+            double *row = &coefs[p * SINC_TAPS];
+            double nu = (double)p / SINC_PHASES;
+            double sum = 0.0;
+            for (int t = 0; t < SINC_TAPS; t++) {
+                double x = (t - (half - 1)) - nu;
+                double sinc = (x == 0.0) ? 1.0
+                                         : sin(M_PI * fc * x) / (M_PI * fc * x);
+                double w = 0.42 + 0.5 * cos(M_PI * x / half) +
+                           0.08 * cos(2 * M_PI * x / half);
+                row[t] = fc * sinc * w;
+                sum += row[t];
+            }
+            // unity gain at DC for every phase
+            for (int t = 0; t < SINC_TAPS; t++)
+                row[t] /= sum;
+        }
+    }
+};
+
+static const SincTable sincTable;
+
+struct SincInterp {
+    static inline const double *phase(double nu, double &a)
+    {
+        double fp = nu * SINC_PHASES;
+        unsigned int p = (unsigned int)fp;
+        a = fp - p;
+        return &sincTable.coefs[p * SINC_TAPS];
+    }
+    template <class T> static inline double read(const T *f, unsigned int stride, double nu)
+    {
+        double a;
+        const double *c0 = phase(nu, a);
+        const double *c1 = c0 + SINC_TAPS;
+        long d = stride;
+        double sum = 0.0;
+        for (int t = 0; t < SINC_TAPS; t++)
+            sum += f[(t - 3) * d] * (c0[t] + a * (c1[t] - c0[t]));
+        return sum;
+    }
+#if defined(__SSE2__)
+    // both frames in one pass over the taps, two taps per lane pair, and a
+    // single horizontal add for the pair of sums
+    template <class T> static inline __m128d mono2(const T *f0, const T *f1, __m128d nu)
+    {
+        double a0, a1;
+        const double *c00 = phase(_mm_cvtsd_f64(nu), a0);
+        const double *c10 = phase(_mm_cvtsd_f64(_mm_unpackhi_pd(nu, nu)), a1);
+        __m128d va0 = _mm_set1_pd(a0);
+        __m128d va1 = _mm_set1_pd(a1);
+        __m128d acc0 = _mm_setzero_pd();
+        __m128d acc1 = _mm_setzero_pd();
+        for (int t = 0; t < SINC_TAPS; t += 2) {
+            __m128d k00 = _mm_load_pd(&c00[t]);
+            __m128d k01 = _mm_load_pd(&c00[t + SINC_TAPS]);
+            __m128d k10 = _mm_load_pd(&c10[t]);
+            __m128d k11 = _mm_load_pd(&c10[t + SINC_TAPS]);
+            __m128d k0 = _mm_add_pd(k00, _mm_mul_pd(va0, _mm_sub_pd(k01, k00)));
+            __m128d k1 = _mm_add_pd(k10, _mm_mul_pd(va1, _mm_sub_pd(k11, k10)));
+            acc0 = _mm_add_pd(acc0, _mm_mul_pd(load2(f0 + t - 3), k0));
+            acc1 = _mm_add_pd(acc1, _mm_mul_pd(load2(f1 + t - 3), k1));
+        }
+        return _mm_add_pd(_mm_unpacklo_pd(acc0, acc1), _mm_unpackhi_pd(acc0, acc1));
+    }
+    template <class T> static inline __m128d stereo1(const T *f, __m128d nu)
+    {
+        double a;
+        const double *c0 = phase(_mm_cvtsd_f64(nu), a);
+        const double *c1 = c0 + SINC_TAPS;
+        __m128d va = _mm_set1_pd(a);
+        __m128d acc = _mm_setzero_pd();
+        for (int t = 0; t < SINC_TAPS; t += 2) {
+            __m128d k0 = _mm_load_pd(&c0[t]);
+            __m128d k1 = _mm_load_pd(&c1[t]);
+            __m128d k = _mm_add_pd(k0, _mm_mul_pd(va, _mm_sub_pd(k1, k0)));
+            const T *g = f + 2 * (t - 3);
+            __m128d kl = _mm_unpacklo_pd(k, k);
+            __m128d kh = _mm_unpackhi_pd(k, k);
+            acc = _mm_add_pd(acc, _mm_mul_pd(load2(g), kl));
+            acc = _mm_add_pd(acc, _mm_mul_pd(load2(g + 2), kh));
+        }
+        return acc;
+    }
+#endif
+#if defined(__AVX__)
+    // the taps of the two frames are in the low and high halves
+    template <class T> static inline __m256d stereo2(const T *f0, const T *f1, __m128d nu)
+    {
+        double a0, a1;
+        const double *c00 = phase(_mm_cvtsd_f64(nu), a0);
+        const double *c10 = phase(_mm_cvtsd_f64(_mm_unpackhi_pd(nu, nu)), a1);
+        __m256d va = spread2(_mm_set_pd(a1, a0));
+        __m256d acc = _mm256_setzero_pd();
+        for (int t = 0; t < SINC_TAPS; t += 2) {
+            __m256d k0 = load2x2(&c00[t], &c10[t]);
+            __m256d k1 = load2x2(&c00[t + SINC_TAPS], &c10[t + SINC_TAPS]);
+            __m256d k = _mm256_add_pd(k0, _mm256_mul_pd(va, _mm256_sub_pd(k1, k0)));
+            const T *g0 = f0 + 2 * (t - 3);
+            const T *g1 = f1 + 2 * (t - 3);
+            acc = _mm256_add_pd(acc, _mm256_mul_pd(load2x2(g0, g1),
+                                                   _mm256_unpacklo_pd(k, k)));
+            acc = _mm256_add_pd(acc, _mm256_mul_pd(load2x2(g0 + 2, g1 + 2),
+                                                   _mm256_unpackhi_pd(k, k)));
+        }
+        return acc;
+    }
+#endif
+};
+
+
+//-----------------------------------------------------------------------------
+// Frame readers, by number of channels of the sound
+//-----------------------------------------------------------------------------
+// any number of channels: even channels go left, odd channels go right
+template <unsigned int Channels, class Interp, class T> struct FrameReader {
+    static inline void read(const T *wave, unsigned int channels,
+                            unsigned long idx, double nu, double &l, double &r)
+    {
+        const T *f = &wave[idx * channels];
+        double sum[2] = {0.0, 0.0};
+        for (unsigned int c = 0; c < channels; c++)
+            sum[c & 1] += Interp::read(f + c, channels, nu);
+        l = sum[0] / ((channels + 1) / 2);
+        r = sum[1] / (channels / 2);
+    }
+};
+
+template <class Interp, class T> struct FrameReader<1, Interp, T> {
+    static inline void read(const T *wave, unsigned int, unsigned long idx,
+                            double nu, double &l, double &r)
+    {
+        l = r = Interp::read(&wave[idx], 1, nu);
+    }
+};
+
+template <class Interp, class T> struct FrameReader<2, Interp, T> {
+    static inline void read(const T *wave, unsigned int, unsigned long idx,
+                            double nu, double &l, double &r)
+    {
+        l = Interp::read(&wave[2 * idx], 2, nu);
+        r = Interp::read(&wave[2 * idx + 1], 2, nu);
+    }
+};
+
+
+//-----------------------------------------------------------------------------
+// Vectorized loops, by number of channels of the sound.  they return the
+// number of frames processed, the remainder being left to the scalar loop.
+//-----------------------------------------------------------------------------
+template <unsigned int Channels, class Interp, class T> struct SourceLanes {
+    static inline unsigned int run(const T *, GrainPhase, GrainPhase,
+                                   const double *, const double *, double *,
+                                   unsigned int)
+    {
+        return 0;
+    }
+};
+
+#if MY_CHANNELS == 2 && defined(__SSE2__)
+template <class Interp, class T> struct SourceLanes<1, Interp, T> {
+    static inline unsigned int run(const T *wave, GrainPhase pos,
+                                   GrainPhase inc, const double *env,
+                                   const double *coefs, double *accumBuff,
+                                   unsigned int n)
+    {
+        unsigned int i = 0;
+#if defined(__AVX__)
+        const __m256d c = _mm256_set_pd(coefs[1], coefs[0], coefs[1], coefs[0]);
+#else
+        const __m128d c = _mm_loadu_pd(coefs);
+#endif
+        GrainPhase p = pos;
+        for (; i + 2 <= n; i += 2) {
+            GrainPhase p1 = p + inc;
+            __m128d nu = laneFracs(p, p1);
+            const T *f0 = &wave[phaseIndex(p)];
+            const T *f1 = &wave[phaseIndex(p1)];
+            p = p1 + inc;
+            __m128d v = _mm_mul_pd(Interp::mono2(f0, f1, nu), _mm_loadu_pd(&env[i]));
+            // copy each frame to both channels
+            double *out = &accumBuff[2 * i];
+#if defined(__AVX__)
+            __m256d lr = _mm256_mul_pd(spread2(v), c);
+            _mm256_storeu_pd(out, _mm256_add_pd(_mm256_loadu_pd(out), lr));
+#else
+            __m128d lr0 = _mm_mul_pd(_mm_unpacklo_pd(v, v), c);
+            __m128d lr1 = _mm_mul_pd(_mm_unpackhi_pd(v, v), c);
+            _mm_storeu_pd(out, _mm_add_pd(_mm_loadu_pd(out), lr0));
+            _mm_storeu_pd(out + 2, _mm_add_pd(_mm_loadu_pd(out + 2), lr1));
+#endif
+        }
+        return i;
+    }
+};
+
+// lanes hold the L/R pair of a frame, two frames per iteration (both in one
+// register with AVX)
+template <class Interp, class T> struct SourceLanes<2, Interp, T> {
+    static inline unsigned int run(const T *wave, GrainPhase pos,
+                                   GrainPhase inc, const double *env,
+                                   const double *coefs, double *accumBuff,
+                                   unsigned int n)
+    {
+        unsigned int i = 0;
+        GrainPhase p = pos;
+#if defined(__AVX__)
+        const __m256d c = _mm256_set_pd(coefs[1], coefs[0], coefs[1], coefs[0]);
+        for (; i + 2 <= n; i += 2) {
+            GrainPhase p1 = p + inc;
+            __m128d nu = laneFracs(p, p1);
+            __m256d g = _mm256_mul_pd(spread2(_mm_loadu_pd(&env[i])), c);
+            const T *f0 = &wave[2 * phaseIndex(p)];
+            const T *f1 = &wave[2 * phaseIndex(p1)];
+            p = p1 + inc;
+            __m256d v = _mm256_mul_pd(Interp::stereo2(f0, f1, nu), g);
+            double *out = &accumBuff[2 * i];
+            _mm256_storeu_pd(out, _mm256_add_pd(_mm256_loadu_pd(out), v));
+        }
+#else
+        const __m128d c = _mm_loadu_pd(coefs);
+        for (; i + 2 <= n; i += 2) {
+            GrainPhase p1 = p + inc;
+            __m128d nu = laneFracs(p, p1);
+            __m128d e = _mm_loadu_pd(&env[i]);
+            const T *f0 = &wave[2 * phaseIndex(p)];
+            const T *f1 = &wave[2 * phaseIndex(p1)];
+            p = p1 + inc;
+            __m128d v0 = _mm_mul_pd(Interp::stereo1(f0, _mm_unpacklo_pd(nu, nu)),
+                                    _mm_mul_pd(_mm_unpacklo_pd(e, e), c));
+            __m128d v1 = _mm_mul_pd(Interp::stereo1(f1, _mm_unpackhi_pd(nu, nu)),
+                                    _mm_mul_pd(_mm_unpackhi_pd(e, e), c));
+            double *out = &accumBuff[2 * i];
+            _mm_storeu_pd(out, _mm_add_pd(_mm_loadu_pd(out), v0));
+            _mm_storeu_pd(out + 2, _mm_add_pd(_mm_loadu_pd(out + 2), v1));
+        }
+#endif
+        return i;
+    }
+};
+#endif
+
+
+//-----------------------------------------------------------------------------
+// Source kernel
+//-----------------------------------------------------------------------------
+template <class T, unsigned int Channels, int Direction, class Interp>
+static void sourceRun(const void *data, unsigned int channels, GrainPhase pos,
+                      GrainPhase step, const double *env, const double *coefs,
+                      double *accumBuff, unsigned int n)
+{
+    const T *wave = (const T *)data;
+    const GrainPhase inc = Direction * step;
+
+    unsigned int i = SourceLanes<Channels, Interp, T>::run(wave, pos, inc, env,
+                                                            coefs, accumBuff, n);
+
+    GrainPhase p = pos + (GrainPhase)i * inc;
+    for (; i < n; i++, p += inc) {
+        double l, r;
+        FrameReader<Channels, Interp, T>::read(wave, channels, phaseIndex(p),
+                                               phaseFrac(p), l, r);
+        // preserve stereo waveform L/R and just sample alternate channels
+        for (int k = 0; k < MY_CHANNELS; k++)
+            accumBuff[i * MY_CHANNELS + k] += ((k % 2) ? r : l) * env[i] * coefs[k];
+    }
+}
+
+// kernels by sample format, channels (any, mono, stereo), direction (-1, 1)
+// and interpolation
+#define SOURCE_KERNELS(t, c, d)                                               \
+    { &sourceRun<t, c, d, LinearInterp>, &sourceRun<t, c, d, HermiteInterp>,  \
+      &sourceRun<t, c, d, SincInterp> }
+
+#define FORMAT_KERNELS(t)                                                     \
+    { {SOURCE_KERNELS(t, 0, -1), SOURCE_KERNELS(t, 0, 1)},                    \
+      {SOURCE_KERNELS(t, 1, -1), SOURCE_KERNELS(t, 1, 1)},                    \
+      {SOURCE_KERNELS(t, 2, -1), SOURCE_KERNELS(t, 2, 1)} }
+
+static const GrainSourceKernel
+    sourceKernels[AUDIOFILE_NUM_FORMATS][3][2][NUM_INTERP_TYPES] = {
+    FORMAT_KERNELS(double),
+    FORMAT_KERNELS(float),
+    FORMAT_KERNELS(int16_t),
+};
+
+#undef FORMAT_KERNELS
+#undef SOURCE_KERNELS
+
+GrainSourceKernel grainSourceKernel(int format, unsigned int channels,
+                                    double direction, int interpType)
+{
+    unsigned int c = (channels <= 2) ? channels : 0;
+    unsigned int d = (direction < 0) ? 0 : 1;
+    if (format < 0 || format >= AUDIOFILE_NUM_FORMATS)
+        format = AUDIOFILE_FLOAT64;
+    if (interpType < 0 || interpType >= NUM_INTERP_TYPES)
+        interpType = INTERP_LINEAR;
+    return sourceKernels[format][c][d][interpType];
+}
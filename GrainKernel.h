@@ -0,0 +1,88 @@
+//------------------------------------------------------------------------------
+// FRONTIÈRES:  An interactive granular sampler.
+//------------------------------------------------------------------------------
+// More information is available at
+//     http::/ccrma.stanford.edu/~carlsonc/256a/Borderlands/index.html
+//
+//
+// Copyright (C) 2018  Jean Pierre Cimalando
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 3.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+//
+//  GrainKernel.h
+//  Frontières
+//
+//  Vectorized routines which render a run of frames of a single grain.
+//  The SSE2 path is used on every x86-64 build, with wider AVX lanes when
+//  built with ENABLE_AVX2, and plain C++ otherwise.
+//
+
+#ifndef GRAINKERNEL_H
+#define GRAINKERNEL_H
+
+#include "theglobals.h"
+#include <stdint.h>
+#include <math.h>
+
+// maximum number of frames rendered by one kernel run
+enum { GRAIN_KERNEL_BLOCK = 256 };
+
+// playheads and window readers are 32.32 fixed-point phase accumulators,
+// in frames: the index and the interpolation coefficient are a shift and a
+// mask away, and increments add up exactly over the grain.
+typedef int64_t GrainPhase;
+enum { GRAIN_PHASE_BITS = 32 };
+
+inline GrainPhase grainPhase(double x)
+{
+    return (GrainPhase)floor(x * 4294967296.0 + 0.5);
+}
+
+// number of frames, at most n, for which the window reader stays at or
+// below the last index of a window of the given length
+unsigned int grainWindowRunLength(GrainPhase reader, GrainPhase inc,
+                                  unsigned int length, unsigned int n);
+
+// number of frames, at most n, for which the playhead stays inside a
+// sound of the given length
+unsigned int grainSourceRunLength(GrainPhase pos, GrainPhase inc,
+                                  unsigned long frames, unsigned int n);
+
+// linearly interpolated read of a run of window values
+void grainWindowRun(const float *window, GrainPhase reader, GrainPhase inc,
+                    double *env, unsigned int n);
+
+// interpolation of the sound sources: 2-point linear, 4-point Hermite and
+// 8-point polyphase windowed-sinc (which reads 3 frames before the playhead
+// and 4 after)
+enum { INTERP_LINEAR, INTERP_HERMITE, INTERP_SINC, NUM_INTERP_TYPES };
+
+// accumulate a run of one sound into the output accumulation buffer,
+// weighted by the envelope and by one gain coefficient per output channel.
+// the playhead starts at pos and moves by step in the direction the kernel
+// was selected for.  the samples of wave are in the format the kernel was
+// selected for.
+typedef void (*GrainSourceKernel)(const void *wave, unsigned int channels,
+                                  GrainPhase pos, GrainPhase step,
+                                  const double *env, const double *coefs,
+                                  double *accumBuff, unsigned int n);
+
+// get the kernel specialized for the sample format of a sound (one of
+// AUDIOFILE_FLOAT64, AUDIOFILE_FLOAT32, AUDIOFILE_INT16), its channel count,
+// a playback direction (1 or -1) and an interpolation type
+GrainSourceKernel grainSourceKernel(int format, unsigned int channels,
+                                    double direction, int interpType);
+
+#endif
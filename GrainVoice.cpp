@@ -28,37 +28,54 @@
 //
 
 #include "GrainVoice.h"
+#include <limits.h>
+#include <string.h>
 
 extern unsigned int samp_rate;
 
+// level under which the sounds of a grain are not rendered (-100 dB)
+static const double GRAIN_SILENCE_LEVEL = 1e-5;
+
 //-------------------AUDIO----------------------------------------------------//
 
 //-----------------------------------------------------------------------------
 // Destructor
 //-----------------------------------------------------------------------------
-GrainVoice::~GrainVoice()
+GrainVoicePool::~GrainVoicePool()
 {
-
-    if (theSounds != NULL)
-        delete theSounds;
-
-    if (playPositions != NULL)
-        delete[] playPositions;
-
-    if (playVols != NULL)
-        delete[] playVols;
-
-    if (window != NULL)
-        delete[] window;
-
-    if (activeSounds != NULL)
-        delete activeSounds;
-
-    if (chanMults)
-        delete[] chanMults;
-
-    if (queuedChanMults)
-        delete[] queuedChanMults;
+    // sounds and windows are shared, only delete the voice state
+    delete[] owner;
+    delete[] prevOwned;
+    delete[] nextOwned;
+    delete[] serial;
+    delete[] loudness;
+    delete[] pitch;
+    delete[] direction;
+    delete[] winInc;
+    delete[] window;
+    delete[] envMode;
+    delete[] envSlot;
+    delete[] envState;
+    delete envelopes;
+    delete[] memo;
+    delete[] memoGains;
+    delete[] memoRecording;
+    delete[] grainFrames;
+    delete[] elapsedFrames;
+    delete[] blockStart;
+    delete[] ended;
+    delete[] activeSlot;
+    delete[] activeVoices;
+    delete[] freeVoices;
+    delete[] numVoiceSounds;
+    delete[] voiceSounds;
+    delete[] playWaves;
+    delete[] playSteps;
+    delete[] playPositions;
+    delete[] playBegin;
+    delete[] playFrames;
+    delete[] playCoefs;
+    delete[] playKernels;
 }
 
 
@@ -66,467 +83,751 @@ GrainVoice::~GrainVoice()
 // Constructor
 //-----------------------------------------------------------------------------
 
-GrainVoice::GrainVoice(vector<AudioFile *> *soundSet, float durationMs, float thePitch)
+GrainVoicePool::GrainVoicePool(vector<AudioFile *> *soundSet, unsigned int maxVoices)
 {
-
-
     // store pointer to external vector of sound files
     theSounds = soundSet;
 
-    // get number of loaded sounds
-    numSounds = (unsigned int)soundSet->size();
-
-    // no active sounds on instantiation
-    activeSounds = NULL;
-
-    // set play positions to -1 for all
-    // note - will have to handle files being added at runtime later if it becomes a feature
-    if (numSounds > 0) {
-        playPositions = new double[numSounds];
-        playVols = new double[numSounds];
-        // initialize - (-1 signifies that sound should not be played)
-        for (int i = 0; i < soundSet->size(); i++) {
-            playPositions[i] = -1.0;
-            playVols[i] = 0.0;
-        }
-    }
-    else {
-        playPositions = NULL;
+    capacity = maxVoices;
+    budget = maxVoices;
+    stealMode = STEAL_OLDEST;
+    triggerCount = 0;
+
+    // everything is allocated here, the audio thread never allocates
+    unsigned long c = capacity;
+    owner = new GrainVoiceList *[c];
+    prevOwned = new int[c];
+    nextOwned = new int[c];
+    serial = new unsigned long[c];
+    loudness = new double[c];
+    pitch = new double[c];
+    direction = new double[c];
+    winInc = new GrainPhase[c];
+    window = new const WindowTable *[c];
+    envMode = new int[c];
+    envSlot = new int[c];
+    envState = new GrainEnvelopeState[c];
+    envelopes = new GrainEnvelopeCache;
+    memo = new GrainMemo *[c];
+    memoGains = new double[c * MY_CHANNELS];
+    memoRecording = new bool[c];
+    grainFrames = new unsigned long[c];
+    elapsedFrames = new unsigned long[c];
+    blockStart = new unsigned int[c];
+    ended = new bool[c];
+    activeSlot = new int[c];
+    activeVoices = new int[c];
+    freeVoices = new int[c];
+    numVoiceSounds = new unsigned int[c];
+    // per source state doesn't depend on the size of the library
+    unsigned long cs = c * GRAIN_MAX_SOURCES;
+    voiceSounds = new unsigned int[cs];
+    playWaves = new const void *[cs];
+    playSteps = new GrainPhase[cs];
+    playPositions = new GrainPhase[cs];
+    playBegin = new unsigned long[cs];
+    playFrames = new unsigned long[cs];
+    playCoefs = new double[cs * MY_CHANNELS];
+    playKernels = new GrainSourceKernel[cs];
+
+    // all voices are free, lowest index on top
+    numActive = 0;
+    numFree = capacity;
+    for (unsigned int v = 0; v < capacity; v++) {
+        owner[v] = NULL;
+        prevOwned[v] = -1;
+        nextOwned[v] = -1;
+        activeSlot[v] = -1;
+        envMode[v] = ENVELOPE_TABLE;
+        envSlot[v] = -1;
+        window[v] = NULL;
+        memo[v] = NULL;
+        memoRecording[v] = false;
+        blockStart[v] = 0;
+        ended[v] = false;
+        numVoiceSounds[v] = 0;
+        freeVoices[v] = capacity - 1 - v;
     }
+}
 
-    // playing status init
-    playingState = false;
-
-
-    // direction
-    if (randf() < 0.5)
-        direction = 1.0;
-    else
-        direction = -1.0;
-    queuedDirection = direction;
-
-    // set default windowType
-    windowType = HANNING;
-    queuedWindowType = windowType;
-
-    // window type is hanning
-    window = Window::Instance().getWindow(windowType);
 
-    // grain volume
-    localAtten = 1.0;
-    queuedLocalAtten = localAtten;
+//-----------------------------------------------------------------------------
+// Voice budget
+//-----------------------------------------------------------------------------
+void GrainVoicePool::setBudget(unsigned int theBudget)
+{
+    if (theBudget > capacity)
+        theBudget = capacity;
+    budget = theBudget;
+}
 
-    // grain duration (ms)
-    duration = durationMs;
-    queuedDuration = durationMs;
+unsigned int GrainVoicePool::getBudget()
+{
+    return budget;
+}
 
-    // grain playback rate
-    pitch = thePitch;
-    queuedPitch = pitch;
 
+//-----------------------------------------------------------------------------
+// Stealing policy
+//-----------------------------------------------------------------------------
+void GrainVoicePool::setStealMode(int theMode)
+{
+    stealMode = theMode;
+}
 
-    // spatialization
-    queuedChanMults = new double[MY_CHANNELS];
-    chanMults = new double[MY_CHANNELS];
-    // set panning values - all channels active by default
-    for (int i = 0; i < MY_CHANNELS; i++) {
-        chanMults[i] = 1.0;
-        queuedChanMults[i] = 1.0;
-    }
+int GrainVoicePool::getStealMode()
+{
+    return stealMode;
+}
 
 
-    // new input flag (no new inputs on instantiation)
-    newParam = false;
+//-----------------------------------------------------------------------------
+// Number of voices currently playing
+//-----------------------------------------------------------------------------
+unsigned int GrainVoicePool::numPlaying()
+{
+    return numActive;
+}
 
-    // set playhead increment
-    playInc = pitch * direction;
-    // initialize window reading params
-    winReader = 0.0;  // 0 idx
 
-    // get duration in samples (fractional)
-    winDurationSamps = ceil(duration * ::samp_rate * (double)0.001);
-    winInc = (double)WINDOW_LEN / winDurationSamps;
+//-----------------------------------------------------------------------------
+// Attach a voice to the front of the list of a cluster
+//-----------------------------------------------------------------------------
+void GrainVoicePool::link(GrainVoiceList *theOwner, unsigned int v)
+{
+    owner[v] = theOwner;
+    prevOwned[v] = -1;
+    nextOwned[v] = theOwner->first;
+    if (theOwner->first != -1)
+        prevOwned[theOwner->first] = v;
+    theOwner->first = v;
+    theOwner->count++;
 }
 
 
 //-----------------------------------------------------------------------------
-// Turn on grain.
-// input args = position and volume vectors in sound rect space
-// returns whether or not grain is awaiting play.
-// parent cloud will wait to play this voice if the voice is still
-// this should not be an issue unless the overlap value is erroneous
+// Detach a voice from its cluster
 //-----------------------------------------------------------------------------
-bool GrainVoice::playMe(double *startPositions, double *startVols)
+void GrainVoicePool::unlink(unsigned int v)
 {
+    GrainVoiceList *theOwner = owner[v];
+    if (prevOwned[v] != -1)
+        nextOwned[prevOwned[v]] = nextOwned[v];
+    else
+        theOwner->first = nextOwned[v];
+    if (nextOwned[v] != -1)
+        prevOwned[nextOwned[v]] = prevOwned[v];
+    theOwner->count--;
+    owner[v] = NULL;
+}
 
-    if (playingState == false) {
-        // next buffer call will play
-        playingState = true;
-
-        // grab queued params if changed
-        if (newParam == true)
-            updateParams();
 
-        // convert relative start positions to sample locations
+//-----------------------------------------------------------------------------
+// Stop a voice, the last playing one fills its slot
+//-----------------------------------------------------------------------------
+void GrainVoicePool::stop(unsigned int v)
+{
+    unlink(v);
+    dropEnvelope(v);
+    dropMemo(v);
 
-        if (activeSounds != NULL)
-            delete activeSounds;
+    int slot = activeSlot[v];
+    int last = activeVoices[--numActive];
+    activeVoices[slot] = last;
+    activeSlot[last] = slot;
+    activeSlot[v] = -1;
 
-        activeSounds = new vector<int>;
+    freeVoices[numFree++] = v;
+}
 
-        for (int i = 0; i < numSounds; i++) {
-            if (startPositions[i] != -1) {
-                activeSounds->push_back(i);
-                playPositions[i] =
-                    floor(startPositions[i] * (theSounds->at(i)->frames - 1));
-                playVols[i] = startVols[i];
-            }
-        }
 
-        // initialize window reader index
-        winReader = 0;
-        return false;
-    }
-    else {
-        // debug
-        // cout << "Grain triggered too soon..." << endl;
-        return true;
-    }
+//-----------------------------------------------------------------------------
+// Release the cached envelope and the window table of a voice
+//-----------------------------------------------------------------------------
+void GrainVoicePool::dropEnvelope(unsigned int v)
+{
+    if (envMode[v] == ENVELOPE_CACHED)
+        envelopes->release(envSlot[v]);
+    envMode[v] = ENVELOPE_TABLE;
+    envSlot[v] = -1;
+    if (window[v])
+        window[v]->grains--;
+    window[v] = NULL;
 }
 
 
 //-----------------------------------------------------------------------------
-// Find out if grain is currently on
+// Stop replaying or recording the memo of a cluster.  a recording stopped
+// before the end leaves the memo invalid.
 //-----------------------------------------------------------------------------
-bool GrainVoice::isPlaying()
+void GrainVoicePool::dropMemo(unsigned int v)
 {
-    return playingState;
+    if (memo[v])
+        memo[v]->users--;
+    memo[v] = NULL;
+    memoRecording[v] = false;
 }
 
 
 //-----------------------------------------------------------------------------
-// Set channel multipliers
+// Memoized grain of a static cloud
 //-----------------------------------------------------------------------------
-void GrainVoice::setChannelMultipliers(double *multipliers)
+static bool memoMatches(const GrainMemo *theMemo, const GrainParams &params,
+                        const GrainSourceList &sources)
 {
-    for (int i = 0; i < MY_CHANNELS; i++) {
-        queuedChanMults[i] = multipliers[i];
+    if (!theMemo->valid || theMemo->duration != params.duration ||
+        theMemo->pitch != params.pitch || theMemo->direction != params.direction ||
+        theMemo->windowSerial != params.window->serial ||
+        theMemo->interpType != params.interpType ||
+        theMemo->sources.count != sources.count)
+        return false;
+
+    // the rects under the grain, and its place in them
+    for (unsigned int j = 0; j < sources.count; j++) {
+        const GrainSource &a = theMemo->sources.sources[j];
+        const GrainSource &b = sources.sources[j];
+        if (a.sound != b.sound || a.position != b.position || a.volume != b.volume)
+            return false;
     }
-    newParam = true;
+    return true;
+}
+
+void GrainVoicePool::recordMemo(unsigned int v, GrainMemo *theMemo,
+                                const GrainParams &params,
+                                const GrainSourceList &sources)
+{
+    // the data is filled as the voice renders, and only replayed once the
+    // voice got to the end of the grain
+    theMemo->valid = false;
+    theMemo->duration = params.duration;
+    theMemo->pitch = params.pitch;
+    theMemo->direction = params.direction;
+    theMemo->windowSerial = params.window->serial;
+    theMemo->interpType = params.interpType;
+    theMemo->sources = sources;
+    theMemo->frames = grainFrames[v];
+    theMemo->loudness = loudness[v];
+    memoRecording[v] = true;
 }
 
 
 //-----------------------------------------------------------------------------
-// Set channel multipliers
+// Level of a voice at its current window position
 //-----------------------------------------------------------------------------
-void GrainVoice::setVolume(float theVolNormed)
+double GrainVoicePool::currentLevel(unsigned int v)
 {
-    float pVol = fabs(theVolNormed);
-    queuedLocalAtten = pVol;
+    unsigned long reader = (elapsedFrames[v] * winInc[v]) >> GRAIN_PHASE_BITS;
+    if (reader > window[v]->length - 1)
+        reader = window[v]->length - 1;
+    return loudness[v] * fabs(window[v]->data[reader]);
 }
 
+
 //-----------------------------------------------------------------------------
-// Get channel multipliers
+// Choose the voice to steal
 //-----------------------------------------------------------------------------
-float GrainVoice::getVolume()
+int GrainVoicePool::pickVictim(GrainVoiceList *theOwner)
 {
-    return localAtten;
+    int victim = -1;
+    double best = 0.0;
+
+    // visit either the voices of the cluster or all the playing ones
+    int a = 0;
+    int v = theOwner ? theOwner->first : (numActive > 0 ? activeVoices[0] : -1);
+
+    while (v != -1) {
+        double score;
+        if (stealMode == STEAL_QUIETEST)
+            score = currentLevel(v);
+        else
+            score = (double)serial[v];
+
+        if (victim == -1 || score < best) {
+            victim = v;
+            best = score;
+        }
+
+        if (theOwner)
+            v = nextOwned[v];
+        else
+            v = (++a < (int)numActive) ? activeVoices[a] : -1;
+    }
+
+    return victim;
 }
 
+
 //-----------------------------------------------------------------------------
-// Set duration (effective on next trigger)
+// Frames of a grain during which a sound is above the silence level
 //-----------------------------------------------------------------------------
-void GrainVoice::setDurationMs(float dur)
+bool GrainVoicePool::audibleSpan(const AudioFile *theSound, unsigned int level,
+                                 GrainPhase pos, GrainPhase inc, unsigned long frames,
+                                 double gain, unsigned long *begin, unsigned long *end)
 {
-    // get absolute value
-    queuedDuration = fabs(dur);
-    if (queuedDuration != duration)
-        newParam = true;
+    *begin = 0;
+    *end = frames;
+    if (!(gain > 0.0))
+        return false;
+    double threshold = GRAIN_SILENCE_LEVEL / gain;
+
+    // frames of the level the playhead goes through
+    GrainPhase last = pos + (GrainPhase)(frames - 1) * inc;
+    long lo = (long)(((inc > 0) ? pos : last) >> GRAIN_PHASE_BITS);
+    long hi = (long)(((inc > 0) ? last : pos) >> GRAIN_PHASE_BITS) + 1;
+
+    // first and last loud blocks
+    const long block = AUDIOFILE_PEAK_BLOCK;
+    long firstLoud = -1, lastLoud = -1;
+    for (long b = lo / block; b <= hi / block; b++) {
+        if (theSound->spanPeak(level, b * block, b * block) >= threshold) {
+            if (firstLoud == -1)
+                firstLoud = b;
+            lastLoud = b;
+        }
+    }
+    if (firstLoud == -1)
+        return false;
+
+    // loud frames, widened by the reach of the interpolation
+    long loudLo = firstLoud * block - AUDIOFILE_GUARD_FRAMES;
+    long loudHi = (lastLoud + 1) * block - 1 + AUDIOFILE_GUARD_FRAMES;
+
+    // back to frames of the grain, rounding outwards
+    const GrainPhase one = (GrainPhase)1 << GRAIN_PHASE_BITS;
+    GrainPhase step = (inc > 0) ? inc : -inc;
+    GrainPhase toStart, toEnd;
+    if (inc > 0) {
+        toStart = loudLo * one - pos;
+        toEnd = (loudHi + 1) * one - pos;
+    }
+    else {
+        toStart = pos - (loudHi + 1) * one;
+        toEnd = pos - loudLo * one;
+    }
+    if (toStart > 0)
+        *begin = (unsigned long)(toStart / step);
+    if (toEnd >= 0 && (unsigned long)(toEnd / step) + 1 < frames)
+        *end = (unsigned long)(toEnd / step) + 1;
+
+    return *begin < *end;
 }
 
 
 //-----------------------------------------------------------------------------
-// Set pitch (effective on next trigger)
+// Where a grain reads a sound, and when it is heard
 //-----------------------------------------------------------------------------
-void GrainVoice::setPitch(float newPitch)
+bool GrainVoicePool::planSound(const GrainSource &source, unsigned int level,
+                               const GrainParams &params, unsigned long grainLength,
+                               unsigned int *soundLevel, GrainPhase *step,
+                               GrainPhase *pos, unsigned long *begin,
+                               unsigned long *end)
 {
-    // get absolute value
-    queuedPitch = newPitch;
-    if (queuedPitch != pitch)
-        newParam = true;
-}
+    AudioFile *theSound = (*theSounds)[source.sound];
+
+    unsigned int l = level;
+    if (l > theSound->numLevels - 1)
+        l = theSound->numLevels - 1;
+    unsigned long levelFrames = theSound->levelFrames[l];
+    *soundLevel = l;
+    *step = grainPhase(ldexp(params.pitch, -(int)l));
+    *pos = (GrainPhase)floor(source.position * (levelFrames - 1)) << GRAIN_PHASE_BITS;
+    // a pitch which rounds to a null step would never move the playhead
+    if (*step == 0)
+        return false;
 
-float GrainVoice::getPitch()
-{
-    if (queuedPitch != pitch)
-        return queuedPitch;
-    else
-        return pitch;
+    // frames until the playhead leaves the sound
+    GrainPhase inc = (params.direction < 0) ? -*step : *step;
+    unsigned long frames = grainSourceRunLength(*pos, inc, levelFrames, grainLength);
+    if (frames == 0)
+        return false;
+
+    // leave out the silent parts
+    double gain = 0.0;
+    for (int k = 0; k < MY_CHANNELS; k++)
+        gain = fmax(gain, fabs(source.volume * params.chanMults[k] * params.volume));
+    return audibleSpan(theSound, l, *pos, inc, frames, gain, begin, end);
 }
 
 
 //-----------------------------------------------------------------------------
-// Update params
+// Turn on grain.
+// input args = sounds under the grain, with position and volume in sound
+// rect space.  returns whether or not grain plays.
 //-----------------------------------------------------------------------------
-void GrainVoice::updateParams()
+bool GrainVoicePool::playMe(GrainVoiceList *theOwner, unsigned int maxOwned,
+                            const GrainParams &params, const GrainSourceList &sources,
+                            unsigned int startFrame)
 {
-    // update parameter set
+    unsigned int numSources = sources.count;
+    if (numSources > GRAIN_MAX_SOURCES)
+        numSources = GRAIN_MAX_SOURCES;
 
-    localAtten = queuedLocalAtten;
+    // how far should we advance through windowing function each sample
+    // (duration in samples, but eliminate fractional component)
+    GrainPhase theWinInc = grainPhase((double)params.window->length /
+                                      ceil(params.duration * ::samp_rate * (double)0.001));
+
+    // length of the grain, up to the end of the window
+    unsigned long theLength = grainWindowRunLength(0, theWinInc, params.window->length,
+                                                   UINT_MAX);
+
+    // octave of the sounds to read, so that the playhead moves by about one
+    // frame per output frame.  the rounding keeps both the aliased band and
+    // the band lost to decimation under half an octave.
+    unsigned int level = 0;
+    if (params.pitch > 1.0)
+        level = (unsigned int)floor(log2(params.pitch) + 0.5);
+
+    // a grain which would only read silence doesn't take a voice.  the
+    // plans are kept for the setup of the sounds.
+    GrainSourcePlan plans[GRAIN_MAX_SOURCES];
+    bool audible = false;
+    for (unsigned int j = 0; j < numSources; j++) {
+        GrainSourcePlan &plan = plans[j];
+        plan.audible = planSound(sources.sources[j], level, params, theLength, &plan.level,
+                                 &plan.step, &plan.pos, &plan.begin, &plan.end);
+        audible = audible || plan.audible;
+    }
+    if (!audible)
+        return false;
 
-    // playback rate
-    pitch = queuedPitch;
+    int v;
 
-    // grain duration in ms
-    duration = queuedDuration;
+    if (theOwner->count > 0 && theOwner->count >= maxOwned) {
+        // the cluster has all its grains out, reuse one of them
+        v = pickVictim(theOwner);
+        finishVictim(v, startFrame);
+        unlink(v);
+        dropEnvelope(v);
+        dropMemo(v);
+    }
+    else if (numFree == 0 || numActive >= budget) {
+        // out of voices, take one from any cluster
+        v = pickVictim(NULL);
+        if (v == -1)
+            return false;
+        finishVictim(v, startFrame);
+        unlink(v);
+        dropEnvelope(v);
+        dropMemo(v);
+    }
+    else {
+        // next buffer call will play
+        v = freeVoices[--numFree];
+        activeSlot[v] = numActive;
+        activeVoices[numActive++] = v;
+    }
 
-    // direction of playback
-    direction = queuedDirection;
+    link(theOwner, v);
+    serial[v] = triggerCount++;
+
+    // grain params
+    pitch[v] = params.pitch;
+    direction[v] = params.direction;
+    // (the window table is kept while a grain plays it)
+    window[v] = params.window;
+    window[v]->grains++;
+    winInc[v] = theWinInc;
+    grainFrames[v] = theLength;
+    elapsedFrames[v] = 0;
+    blockStart[v] = startFrame;
+    ended[v] = false;
+    numVoiceSounds[v] = 0;
+
+    // a static cloud records its grain at unit gain and pan while the first
+    // one plays, in the render step like any grain, and the next ones replay
+    // it.  it is only recorded again when no voice uses it.
+    GrainMemo *theMemo = params.memo;
+    if (theMemo && !memoMatches(theMemo, params, sources)) {
+        if (theMemo->users == 0 && theLength <= GRAIN_MEMO_FRAMES) {
+            GrainParams unit = params;
+            unit.volume = 1.0f;
+            for (int k = 0; k < MY_CHANNELS; k++)
+                unit.chanMults[k] = 1.0;
+            unit.memo = NULL;
+            // (planned again, at the unit gain the memo is recorded at)
+            setupSources(v, level, unit, sources, NULL);
+            recordMemo(v, theMemo, unit, sources);
+        }
+        else
+            theMemo = NULL;
+    }
 
-    // playhead increment
-    playInc = direction * pitch;
+    if (theMemo) {
+        memo[v] = theMemo;
+        theMemo->users++;
+        loudness[v] = 0.0;
+        for (int k = 0; k < MY_CHANNELS; k++) {
+            double gain = params.chanMults[k] * params.volume;
+            memoGains[v * MY_CHANNELS + k] = gain;
+            if (fabs(gain * theMemo->loudness) > loudness[v])
+                loudness[v] = fabs(gain * theMemo->loudness);
+        }
+        return true;
+    }
+
+    setupSources(v, level, params, sources, plans);
+    return true;
+}
 
-    // window
-    windowType = queuedWindowType;
 
-    // switch window
-    window = Window::Instance().getWindow(windowType);
+//-----------------------------------------------------------------------------
+// Envelope and sounds of a grain which was given voice v
+//-----------------------------------------------------------------------------
+void GrainVoicePool::setupSources(unsigned int v, unsigned int level,
+                                  const GrainParams &params,
+                                  const GrainSourceList &sources,
+                                  const GrainSourcePlan *plans)
+{
+    unsigned int numSources = sources.count;
+    if (numSources > GRAIN_MAX_SOURCES)
+        numSources = GRAIN_MAX_SOURCES;
+
+    // envelope: in closed form if the shape has one, else shared with the
+    // grains of the same window and duration, else read from the table
+    envMode[v] = grainEnvelopeAnalytic(window[v], winInc[v], &envState[v]);
+    if (envMode[v] == ENVELOPE_TABLE) {
+        envSlot[v] = envelopes->acquire(window[v], winInc[v], grainFrames[v]);
+        if (envSlot[v] != -1)
+            envMode[v] = ENVELOPE_CACHED;
+    }
 
-    // double value, but eliminate fractional component -
-    winDurationSamps = ceil(duration * ::samp_rate * (double)0.001);
+    // convert relative start positions to sample locations
+    numVoiceSounds[v] = 0;
+    loudness[v] = 0.0;
+
+    for (unsigned int j = 0; j < numSources; j++) {
+        const GrainSource &source = sources.sources[j];
+        AudioFile *theSound = (*theSounds)[source.sound];
+        unsigned long s = (unsigned long)v * GRAIN_MAX_SOURCES + numVoiceSounds[v];
+
+        GrainSourcePlan plan;
+        if (plans)
+            plan = plans[j];
+        else
+            plan.audible = planSound(source, level, params, grainFrames[v], &plan.level,
+                                     &plan.step, &plan.pos, &plan.begin, &plan.end);
+        if (!plan.audible)
+            continue;
+        playSteps[s] = plan.step;
+        playPositions[s] = plan.pos;
+        playBegin[s] = plan.begin;
+        playFrames[s] = plan.end;
+        playWaves[s] = theSound->levelWave[plan.level];
+
+        // all gains are constant for the life of the grain
+        for (int k = 0; k < MY_CHANNELS; k++) {
+            double coef = source.volume * params.chanMults[k] * params.volume;
+            playCoefs[s * MY_CHANNELS + k] = coef * theSound->scale;
+            if (fabs(coef) > loudness[v])
+                loudness[v] = fabs(coef);
+        }
 
-    // how far should we advance through windowing function each sample
-    winInc = (double)WINDOW_LEN / winDurationSamps;
+        // rendering routine for the whole life of the grain
+        playKernels[s] = grainSourceKernel(theSound->format, theSound->channels,
+                                           direction[v], params.interpType);
 
-    // spatialization - get new channel multipliers
-    for (int i = 0; i < MY_CHANNELS; i++) {
-        chanMults[i] = queuedChanMults[i];
+        voiceSounds[s] = source.sound;
+        numVoiceSounds[v]++;
     }
-
-    // all params have been updated
-    newParam = false;
 }
 
 
 //-----------------------------------------------------------------------------
-// Set window type (effective on next trigger)
+// Stop all grains of a cluster
 //-----------------------------------------------------------------------------
-
-void GrainVoice::setWindow(unsigned int theType)
+void GrainVoicePool::release(GrainVoiceList *theOwner)
 {
-    queuedWindowType = theType;
-    if (queuedWindowType != windowType)
-        newParam = true;
+    while (theOwner->first != -1)
+        stop(theOwner->first);
 }
 
 
 //-----------------------------------------------------------------------------
-// Set direction (effective on next trigger)
+// Render the grains of a cluster over the block
 //-----------------------------------------------------------------------------
-
-void GrainVoice::setDirection(float thedir)
+void GrainVoicePool::render(GrainVoiceList *theOwner, unsigned int numFrames)
 {
-    queuedDirection = thedir;
-    if (queuedDirection != direction)
-        newParam = true;
+    // only visit the grains of this cluster, and only write to their state
+    for (int v = theOwner->first; v != -1; v = nextOwned[v]) {
+        unsigned int first = blockStart[v];
+        if (first < numFrames && !ended[v])
+            ended[v] = !renderVoice(v, theOwner->buffer, numFrames - first, first);
+    }
 }
 
 
 //-----------------------------------------------------------------------------
-// Compute next sub buffer of audio
+// Return the voices which ended, the others go on from the next block start
 //-----------------------------------------------------------------------------
-
-
-void GrainVoice::nextBuffer(double *accumBuff, unsigned int numFrames,
-                            unsigned int bufferOffset, int name)
+void GrainVoicePool::endBlock()
 {
+    // from the end, since a stop moves the last voice into its slot
+    for (int a = (int)numActive - 1; a >= 0; a--) {
+        int v = activeVoices[a];
+        if (ended[v])
+            stop(v);
+        else
+            blockStart[v] = 0;
+    }
+}
 
-    // fill stereo accumulation buffer.  note, buffer output must be interlaced
-    // ch1,ch2,ch1,ch2, etc... and playPositions are in frames, NOT SAMPLES.
-
-    // only go through this ordeal if grain is active
-    if (playingState == true) {
-        // initialize local vars
 
-        // linear interp coeff
-        double nu = 0.0;
+//-----------------------------------------------------------------------------
+// A voice about to be stolen plays until the frame of the new grain, then
+// fades out (into the frames past the block if it has to)
+//-----------------------------------------------------------------------------
+void GrainVoicePool::finishVictim(unsigned int v, unsigned int frame)
+{
+    double *accumBuff = owner[v]->buffer;
+    if (ended[v] || !accumBuff)
+        return;
 
-        // next window value
-        double nextMult = 0.0;
+    // (a grain which has not started yet is dropped as is)
+    unsigned int first = blockStart[v];
+    if (first >= frame && elapsedFrames[v] == 0)
+        return;
+    if (first < frame && !renderVoice(v, accumBuff, frame - first, first))
+        return;
 
-        // ref idx for left bound of interp
-        double flooredIdx = 0;
+    // the rest of the grain, up to the length of the fade, at full gain
+    double fadeBuff[GRAIN_STEAL_FADE * MY_CHANNELS];
+    unsigned long fadeFrames = grainFrames[v] - elapsedFrames[v];
+    if (fadeFrames > (unsigned long)GRAIN_STEAL_FADE)
+        fadeFrames = GRAIN_STEAL_FADE;
+    memset(fadeBuff, 0, fadeFrames * MY_CHANNELS * sizeof(double));
+    renderVoice(v, fadeBuff, fadeFrames, 0);
+
+    double *out = &accumBuff[frame * MY_CHANNELS];
+    for (unsigned long i = 0; i < fadeFrames; i++) {
+        double gain = (double)(GRAIN_STEAL_FADE - i) / GRAIN_STEAL_FADE;
+        for (int k = 0; k < MY_CHANNELS; k++)
+            out[k] += gain * fadeBuff[i * MY_CHANNELS + k];
+        out += MY_CHANNELS;
+    }
+}
 
-        // next file index
-        int nextSound = -1;
 
-        // waveform params
-        double *wave = NULL;
-        int channels = 0;
-        unsigned int frames = 0;
+//-----------------------------------------------------------------------------
+// Render a playing voice, returns whether it still plays afterwards
+//-----------------------------------------------------------------------------
+bool GrainVoicePool::renderVoice(unsigned int v, double *accumBuff,
+                                 unsigned int numFrames, unsigned int bufferOffset)
+{
 
-        // file reader position
-        double pos = -1.0;
+    // fill stereo accumulation buffer.  note, buffer output must be interlaced
+    // ch1,ch2,ch1,ch2, etc... and playPositions are in frames, NOT SAMPLES.
 
-        // attenuation value
-        double atten = 0.0;
+    // replay of a memoized grain, with the gains of this trigger
+    if (memo[v] && !memoRecording[v]) {
+        unsigned long run = grainFrames[v] - elapsedFrames[v];
+        if (run > numFrames)
+            run = numFrames;
+        const float *in = &memo[v]->data[elapsedFrames[v] * MY_CHANNELS];
+        const double *gains = &memoGains[v * MY_CHANNELS];
+        double *out = &accumBuff[bufferOffset * MY_CHANNELS];
+        for (unsigned long i = 0; i < run; i++) {
+            for (int k = 0; k < MY_CHANNELS; k++)
+                out[k] += gains[k] * in[k];
+            in += MY_CHANNELS;
+            out += MY_CHANNELS;
+        }
+        elapsedFrames[v] += run;
+        return elapsedFrames[v] < grainFrames[v];
+    }
 
-        // output values
-        double nextAmp = 0.0;
-        double monoWaveVal = 0.0;
-        double stereoLeftVal = 0.0;
-        double stereoRightVal = 0.0;
+    // window values of the current run
+    double envBuff[GRAIN_KERNEL_BLOCK];
+    // the run at unit gain, when recording the memo
+    double unitBuff[GRAIN_KERNEL_BLOCK * MY_CHANNELS];
+
+    // kernel block
+    while (numFrames > 0) {
+        unsigned long run = grainFrames[v] - elapsedFrames[v];
+        if (run > numFrames)
+            run = numFrames;
+        if (run > (unsigned long)GRAIN_KERNEL_BLOCK)
+            run = GRAIN_KERNEL_BLOCK;
+
+        // window multipliers
+        const double *env = envBuff;
+        switch (envMode[v]) {
+        case ENVELOPE_CACHED:
+            env = envelopes->envelope(envSlot[v]) + elapsedFrames[v];
+            break;
+        case ENVELOPE_HANN:
+            grainHannRun(&envState[v], envBuff, run);
+            break;
+        case ENVELOPE_EXP:
+            grainExpRun(&envState[v], envBuff, run);
+            break;
+        default:
+            grainWindowRun(window[v]->data, elapsedFrames[v] * winInc[v], winInc[v],
+                           envBuff, run);
+            break;
+        }
 
+        double *out = &accumBuff[bufferOffset * MY_CHANNELS];
+        if (memoRecording[v]) {
+            memset(unitBuff, 0, run * MY_CHANNELS * sizeof(double));
+            out = unitBuff;
+        }
 
-        // iterate over requested number of samples
-        for (int i = 0; i < numFrames; i++) {
+        // accumulate from each sound under grain
+        //-- REMEMBER - playPositions are in frames, not samples
+        for (unsigned int j = 0; j < numVoiceSounds[v]; j++) {
+
+            unsigned long s = (unsigned long)v * GRAIN_MAX_SOURCES + j;
+
+            // frames of this run during which the sound is heard
+            unsigned long first = elapsedFrames[v];
+            unsigned long last = elapsedFrames[v] + run;
+            if (first < playBegin[s])
+                first = playBegin[s];
+            if (last > playFrames[s])
+                last = playFrames[s];
+            if (first >= last)
+                continue;
+            unsigned long skip = first - elapsedFrames[v];
+
+            AudioFile *theSound = (*theSounds)[voiceSounds[s]];
+            GrainPhase inc = (direction[v] < 0) ? -playSteps[s] : playSteps[s];
+            GrainPhase pos = playPositions[s] + (GrainPhase)first * inc;
+            const double *coefs = &playCoefs[s * MY_CHANNELS];
+
+            playKernels[s](playWaves[s], theSound->channels, pos, playSteps[s],
+                           env + skip, coefs, out + skip * MY_CHANNELS, last - first);
+        }
 
-            // Window multiplier - Get next val from window and check to see if we've reached the end
-            if (winReader > (WINDOW_LEN - 1)) {
-                nextMult = (double)0.0;
-                winReader = 0;
-                playingState = false;
-                return;
-            }
-            else {
-                // interpolated read from window buffer
-                flooredIdx = floor(winReader);
-                nu = winReader - flooredIdx;  // interp coeff
-                // interpolated read (lin)
-                nextMult = ((double)1.0 - nu) * window[(unsigned long)flooredIdx] +
-                           nu * window[(unsigned long)flooredIdx + 1];
-                // increment reader
-                winReader += winInc;
+        // into the memo, and out with the gains of this trigger the way
+        // the replays do
+        if (memoRecording[v]) {
+            float *rec = &memo[v]->data[elapsedFrames[v] * MY_CHANNELS];
+            const double *gains = &memoGains[v * MY_CHANNELS];
+            double *dest = &accumBuff[bufferOffset * MY_CHANNELS];
+            for (unsigned long i = 0; i < run; i++) {
+                for (int k = 0; k < MY_CHANNELS; k++) {
+                    rec[k] = (float)unitBuff[i * MY_CHANNELS + k];
+                    dest[k] += gains[k] * rec[k];
+                }
+                rec += MY_CHANNELS;
+                dest += MY_CHANNELS;
             }
+        }
 
+        elapsedFrames[v] += run;
+        bufferOffset += run;
+        numFrames -= run;
 
-            // reinit sound accumulators for mono and stereo files to prepare for this frame
-            monoWaveVal = 0.0;
-            stereoLeftVal = 0.0;
-            stereoRightVal = 0.0;
-
-            // Get next audio frame data (accumulate from each sound under grain)
-            //-- REMEMBER - playPositions are in frames, not samples
-            for (int j = 0; j < activeSounds->size(); j++) {
-
-                nextSound = activeSounds->at(j);
-                pos = playPositions[nextSound];  // get start position
-                atten = playVols[nextSound];  // get volume relative to rect
-
-
-                // if sound is in play,sample it
-                if (pos > 0) {
-
-                    // sound vars
-                    wave = theSounds->at(nextSound)->wave;
-                    channels = theSounds->at(nextSound)->channels;
-                    frames = theSounds->at(nextSound)->frames;
-
-                    // get info for interpolation based on frame location
-                    flooredIdx = floor(pos);
-                    nu = pos - flooredIdx;
-
-                    // handle mono and stereo files separately.
-                    switch (channels) {
-                    case 1:
-
-                        // get next linearly interpolated sample val and make sure we are still inside
-                        if ((flooredIdx >= 0) && ((flooredIdx + 1) < (frames - 1))) {
-                            nextAmp = (((double)1.0 - nu) * wave[(unsigned long)flooredIdx] +
-                                       nu * wave[(unsigned long)flooredIdx + 1]) *
-                                      nextMult * atten;
-
-                            // accumulate mono frame
-                            monoWaveVal += nextAmp;
-
-                            /*//old
-                             accumBuff[(bufferOffset + i)*MY_CHANNELS] += nextAmp;
-                            //copy to other channels for mono
-                            for (int k = 1; k < MY_CHANNELS; k++){
-                                accumBuff[(bufferOffset + i) * MY_CHANNELS + k] += nextAmp;
-                            }
-                             */
-
-                            // advance after each stereo frame (do calc twice for mono)
-                            playPositions[nextSound] += playInc;
-                        }
-                        else {
-                            // not playing anymore
-                            playPositions[nextSound] = -1.0;
-                        }
-                        break;
-                    case 2:  // stereo
-
-                        // make sure we are still in sound
-                        if ((flooredIdx >= 0) && ((flooredIdx + 1) < (frames - 1))) {
-
-
-                            // left channel
-                            stereoLeftVal +=
-                                (((double)1.0 - nu) * wave[(unsigned long)flooredIdx * 2] +
-                                 nu * wave[(unsigned long)(flooredIdx + 1) * 2]) *
-                                nextMult * atten;
-                            // right channel
-                            stereoRightVal +=
-                                (((double)1.0 - nu) * wave[(unsigned long)flooredIdx * 2 + 1] +
-                                 nu * wave[(unsigned long)(flooredIdx + 1) * 2 + 1]) *
-                                nextMult * atten;
-
-                            /*//old
-                            //left channel
-                            accumBuff[(bufferOffset + i)*MY_CHANNELS] += (((double)
-                            1.0 - nu)*wave[(unsigned long)flooredIdx*2] + nu * wave[(unsigned long)(flooredIdx + 1)*2])*nextMult*atten;
-
-                            //right channel
-                            accumBuff[(bufferOffset + i) * MY_CHANNELS + 1] +=
-                            (((double) 1.0 - nu)*wave[(unsigned long)flooredIdx*2 + 1] + nu * wave[(unsigned long)(flooredIdx + 1)*2 + 1])*nextMult*atten;
-                             */
-
-                            // advance after each stereo frame (do calc twice for mono)
-                            playPositions[nextSound] += playInc;
-                        }
-                        else {
-                            // not playing anymore
-                            playPositions[nextSound] = -1.0;
-                        }
-                        break;
-                        // don't handle numbers of channels > 2
-                    default:
-                        break;
-                    }  // end switch channels
-
-                }  // end position check
-
-            }  // end accumulation for current frame
-
-            // spatialize output
-            for (int k = 0; k < MY_CHANNELS; k++) {
-                // preserve stereo waveform L/R for now and just sample alternate channels in "AROUND" case (see GrainCluster.cpp updateSpatialization routine)
-                if ((k % 2) == 0) {
-                    accumBuff[(bufferOffset + i) * MY_CHANNELS + k] +=
-                        (stereoLeftVal + monoWaveVal) * chanMults[k] * localAtten;
-                }
-                else {
-                    accumBuff[(bufferOffset + i) * MY_CHANNELS + k] +=
-                        (stereoRightVal + monoWaveVal) * chanMults[k] * localAtten;
-                }
-
-                // clip if needed
-                if (accumBuff[(bufferOffset + i) * MY_CHANNELS + k] > 1.0) {
-                    accumBuff[(bufferOffset + i) * MY_CHANNELS + k] = 1.0;
-                }
-                else {
-                    if (accumBuff[(bufferOffset + i) * MY_CHANNELS + k] < -1.0) {
-                        accumBuff[(bufferOffset + i) * MY_CHANNELS + k] = -1.0;
-                    }
-                }
-            }
+        // end of the window
+        if (elapsedFrames[v] >= grainFrames[v]) {
+            if (memoRecording[v])
+                memo[v]->valid = true;
+            return false;
         }
     }
-    else {
-        // cout << "return - not playing " << endl;
-        return;
-    }
+
+    return true;
 }
 
 //----------------------------------------------------------------------------------------------//
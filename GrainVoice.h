@@ -33,6 +33,8 @@
 #include "theglobals.h"
 #include "AudioFileSet.h"
 #include "Window.h"
+#include "GrainKernel.h"
+#include "GrainEnvelope.h"
 #include <vector>
 #include <math.h>
 #include <time.h>
@@ -48,102 +50,293 @@
 
 
 // forward declarations
-class GrainVoice;
+class GrainVoicePool;
 class GrainVis;
+struct GrainMemo;
+
+
+// voice stealing policies
+enum { STEAL_OLDEST, STEAL_QUIETEST };
+
+// frames over which a stolen grain fades out (about 3 ms)
+enum { GRAIN_STEAL_FADE = 128 };
+
+
+// parameters of a grain, fixed for its whole life
+struct GrainParams {
+    // duration (ms)
+    float duration;
+    // playback rate and direction (1 or -1)
+    double pitch;
+    double direction;
+    // window table (not RANDOM_WIN)
+    const WindowTable *window;
+    // interpolation of the sounds
+    int interpType;
+    // grain volume
+    float volume;
+    // panning values
+    double chanMults[MY_CHANNELS];
+    // rendering of the grain kept by a static cloud, NULL if there is none
+    GrainMemo *memo;
+};
+
+
+// most sounds a single grain plays at once (overlapping rects under it)
+enum { GRAIN_MAX_SOURCES = 16 };
+
+// sounds under a grain at trigger: index, relative position and volume
+struct GrainSource {
+    unsigned int sound;
+    double position;
+    double volume;
+};
+
+struct GrainSourceList {
+    unsigned int count;
+    GrainSource sources[GRAIN_MAX_SOURCES];
+};
+
+// where a grain reads one of its sounds (see GrainVoicePool::planSound)
+struct GrainSourcePlan {
+    bool audible;
+    unsigned int level;
+    GrainPhase step, pos;
+    unsigned long begin, end;
+};
+
+
+// longest grain which is memoized (frames)
+enum { GRAIN_MEMO_FRAMES = 65536 };
+
+// a grain rendered once at unit gain and pan, which the triggers of a static
+// cloud replay with their own gains.  the cluster owns it and the pool fills
+// it while the first grain renders; it is recorded again when the grain it
+// was made from changes.
+struct GrainMemo {
+    // whether data holds the grain below
+    bool valid;
+    float duration;
+    double pitch;
+    double direction;
+    unsigned long windowSerial;
+    int interpType;
+    GrainSourceList sources;
+    // length, gain of the loudest sound, and voices replaying it
+    unsigned long frames;
+    double loudness;
+    unsigned int users;
+    // MY_CHANNELS interleaved, GRAIN_MEMO_FRAMES long
+    float *data;
+};
+
+
+// voices a cluster has borrowed from the pool (linked through the pool),
+// and the buffer of the block they render into, which has GRAIN_STEAL_FADE
+// frames past the block for the fades of the stolen grains
+struct GrainVoiceList {
+    int first;
+    unsigned int count;
+    double *buffer;
+};
 
 
 // AUDIO CLASS
-class GrainVoice {
+// the grain voices of the whole engine, allocated once at startup and
+// borrowed by the clusters when they trigger a grain.  the state of the
+// voices is kept in parallel arrays indexed by voice, the voices which play
+// are listed globally and per cluster, and the idle ones on a free stack.
+//
+// a block goes in three phases: the clusters trigger their grains one after
+// the other (playMe), then render them, each into its own buffer and
+// possibly on several threads (render), and the voices which ended return
+// to the pool (endBlock).  only render may run concurrently, for distinct
+// clusters.
+class GrainVoicePool {
 
 public:
     // destructor
-    virtual ~GrainVoice();
+    virtual ~GrainVoicePool();
 
     // constructor
-    GrainVoice(vector<AudioFile *> *soundSet, float durationMs, float thePitch);
+    GrainVoicePool(vector<AudioFile *> *soundSet, unsigned int maxVoices);
 
-    // dump samples into next buffer
-    void nextBuffer(double *accumBuff, unsigned int numFrames,
-                    unsigned int bufferPos, int name);
+    // number of voices which may play at once (at most maxVoices)
+    void setBudget(unsigned int theBudget);
+    unsigned int getBudget();
 
+    // which voice to take when the budget is used up
+    void setStealMode(int theMode);
+    int getStealMode();
 
-    // set on
-    bool playMe(double *startPositions, double *startVols);
+    // number of voices playing
+    unsigned int numPlaying();
 
-    // report state
-    bool isPlaying();
+    // start a grain at a frame of the block, for a cluster which may play
+    // maxOwned grains at once.  a voice is stolen if the cluster or the
+    // whole pool is at its limit, once it has rendered up to that frame and
+    // faded out over the next GRAIN_STEAL_FADE.  returns whether the grain
+    // plays.
+    bool playMe(GrainVoiceList *owner, unsigned int maxOwned,
+                const GrainParams &params, const GrainSourceList &sources,
+                unsigned int startFrame);
 
-    // queue up params for next grain
-    void setDurationMs(float dur);
+    // render the first frames of the block of the grains of a cluster into
+    // its buffer
+    void render(GrainVoiceList *owner, unsigned int numFrames);
 
-    // set/get playback rate
-    void setPitch(float newPitch);
+    // return the voices which ended in this block
+    void endBlock();
 
-    // get playback rate
-    float getPitch();
+    // stop all grains of a cluster
+    void release(GrainVoiceList *owner);
 
-    // volume
-    void setVolume(float theVolNormed);
-    float getVolume();
+protected:
+    // render a playing voice, returns false once the grain is over
+    bool renderVoice(unsigned int v, double *accumBuff, unsigned int numFrames,
+                     unsigned int bufferOffset);
 
-    // set spatialization
-    void setChannelMultipliers(double *multipliers);
+    // pick the voice to steal, among those of a cluster or all if NULL
+    int pickVictim(GrainVoiceList *owner);
 
-    // set playback direction
-    void setDirection(float thedir);
+    // render a voice about to be stolen up to a frame of the block, and
+    // fade it out from there
+    void finishVictim(unsigned int v, unsigned int frame);
 
-    // change window type
-    void setWindow(unsigned int windowType);
+    // how loud a voice plays at the moment
+    double currentLevel(unsigned int v);
 
+    // attach a voice to a cluster / detach it
+    void link(GrainVoiceList *owner, unsigned int v);
+    void unlink(unsigned int v);
 
-protected:
-    // makes temp  params permanent
-    void updateParams();
+    // stop a voice and return it to the free stack
+    void stop(unsigned int v);
+
+    // let go of the envelope and the window of a voice
+    void dropEnvelope(unsigned int v);
+
+    // let go of the memo a voice replays
+    void dropMemo(unsigned int v);
+
+    // record the grain set up on voice v into the memo of its cluster, as
+    // the voice renders
+    void recordMemo(unsigned int v, GrainMemo *memo, const GrainParams &params,
+                    const GrainSourceList &sources);
+
+    // envelope and sounds of the grain given voice v, from the plans of its
+    // sounds (planned here if NULL)
+    void setupSources(unsigned int v, unsigned int level, const GrainParams &params,
+                      const GrainSourceList &sources, const GrainSourcePlan *plans);
+
+    // where a grain reads a source: octave level, playhead step and start
+    // phase, and frames [*begin, *end) during which it is heard.  returns
+    // false if it isn't.
+    bool planSound(const GrainSource &source, unsigned int level,
+                   const GrainParams &params, unsigned long grainLength,
+                   unsigned int *soundLevel, GrainPhase *step, GrainPhase *pos,
+                   unsigned long *begin, unsigned long *end);
+
+    // frames [*begin, *end) of a grain during which a sound plays above the
+    // silence level, given its highest gain.  returns false if it never does.
+    bool audibleSpan(const AudioFile *theSound, unsigned int level, GrainPhase pos,
+                     GrainPhase inc, unsigned long frames, double gain,
+                     unsigned long *begin, unsigned long *end);
 
 private:
     // pointer to all audio file buffers
     vector<AudioFile *> *theSounds;
-    // status
-    bool playingState;
-    // param update required flag
-    bool newParam;
 
-    // numsounds
-    unsigned int numSounds;
+    // number of voices, and how many may play
+    unsigned int capacity;
+    unsigned int budget;
+    int stealMode;
 
-    // grain parameters
-    float duration, queuedDuration;
-    double winDurationSamps;
-    double pitch, queuedPitch;
-    double direction, queuedDirection;
-    double playInc;
+    // count of triggered grains
+    unsigned long triggerCount;
 
-    // local volume (set by user)
-    float localAtten;
-    float queuedLocalAtten;
+    // PER VOICE
 
-    // panning values
-    double *chanMults;
-    double *queuedChanMults;
+    // owning cluster, and links to the other voices it owns
+    GrainVoiceList **owner;
+    int *prevOwned;
+    int *nextOwned;
 
-    // audio files being sampled
-    vector<int> *activeSounds;
+    // trigger order, and gain of the loudest sound
+    unsigned long *serial;
+    double *loudness;
 
-    // window type
-    unsigned int windowType, queuedWindowType;
+    // playback rate and direction
+    double *pitch;
+    double *direction;
 
     // window reading params
-    double winInc;
-    double winReader;
+    GrainPhase *winInc;
+
+    // audio window (hanning, triangle, etc.)
+    const WindowTable **window;
+
+    // how the envelope is produced (see GrainEnvelope.h), the cache slot of
+    // cached envelopes and the state of analytic ones
+    int *envMode;
+    int *envSlot;
+    GrainEnvelopeState *envState;
+
+    // envelopes shared by the grains of equal window and duration
+    GrainEnvelopeCache *envelopes;
 
-    // pointer to audio window (hanning, triangle, etc.)
-    double *window;
+    // memo replayed instead of the sounds (NULL if none), and its gain on
+    // each channel (MY_CHANNELS per voice)
+    GrainMemo **memo;
+    double *memoGains;
+    // whether the voice renders the sounds into its memo rather than
+    // replaying it
+    bool *memoRecording;
 
+    // length of the grain in frames, and number of frames rendered so far
+    unsigned long *grainFrames;
+    unsigned long *elapsedFrames;
 
-    // array of position values (in frames, not samples)
-    //-1 means not in current soundfile
-    double *playPositions;
-    double *playVols;
+    // frame of the block where the voice starts rendering, and whether it
+    // ended in the block
+    unsigned int *blockStart;
+    bool *ended;
+
+    // slot in the playing list, -1 if the voice doesn't play
+    int *activeSlot;
+
+    // PLAYING LIST AND FREE STACK
+    int *activeVoices;
+    unsigned int numActive;
+    int *freeVoices;
+    unsigned int numFree;
+
+    // PER VOICE AND SOURCE (GRAIN_MAX_SOURCES per voice, numVoiceSounds used)
+
+    // audio files being sampled
+    unsigned int *numVoiceSounds;
+    unsigned int *voiceSounds;
+
+    // octave level of each sound being read, and playhead step in that
+    // level (the pitch divided by 2^level)
+    const void **playWaves;
+    GrainPhase *playSteps;
+
+    // array of playhead phases at trigger (in frames of the level, not samples)
+    GrainPhase *playPositions;
+
+    // frames of the grain during which each sound plays: from the first
+    // one where it is audible, to the one where it leaves its file or falls
+    // silent for good
+    unsigned long *playBegin;
+    unsigned long *playFrames;
+    // gain coefficients of each sound (MY_CHANNELS per sound), which fold
+    // the relative volume, the panning, the grain volume and the scale of
+    // the sample format together
+    double *playCoefs;
+    // kernel rendering each sound, specialized on its sample format, its
+    // channel count and on the direction of the grain
+    GrainSourceKernel *playKernels;
 };
 
 
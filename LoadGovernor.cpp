@@ -0,0 +1,148 @@
+//------------------------------------------------------------------------------
+// FRONTIÈRES:  An interactive granular sampler.
+//------------------------------------------------------------------------------
+// More information is available at
+//     http::/ccrma.stanford.edu/~carlsonc/256a/Borderlands/index.html
+//
+//
+// Copyright (C) 2018  Jean Pierre Cimalando
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 3.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+
+//
+//  LoadGovernor.cpp
+//  Frontières
+//
+
+#include "LoadGovernor.h"
+#include "GrainKernel.h"
+#include <math.h>
+
+// load above which quality goes down a step, and below which it goes back up
+#define LOAD_HIGH 0.75
+#define LOAD_LOW 0.45
+// time between two steps down, and time spent under the low mark before a
+// step up (s)
+#define LOAD_HOLD_SECONDS 0.25
+#define LOAD_RECOVER_SECONDS 3.0
+// time constant of the load falling back (s), it rises at once
+#define LOAD_RELEASE_SECONDS 0.5
+
+
+//-----------------------------------------------------------------------------
+// Constructor / destructor
+//-----------------------------------------------------------------------------
+LoadGovernor::~LoadGovernor()
+{
+}
+
+LoadGovernor::LoadGovernor(unsigned int theSampleRate)
+{
+    sampleRate = theSampleRate;
+    blockStart = std::chrono::steady_clock::now();
+    load = 0.0;
+    level = LOAD_FULL;
+    xruns = 0;
+    holdTime = 0.0;
+    calmTime = 0.0;
+}
+
+
+//-----------------------------------------------------------------------------
+// Measurement
+//-----------------------------------------------------------------------------
+void LoadGovernor::beginBlock()
+{
+    blockStart = std::chrono::steady_clock::now();
+}
+
+void LoadGovernor::endBlock(unsigned int numFrames, bool xrun)
+{
+    if (numFrames == 0)
+        return;
+
+    std::chrono::duration<double> spent = std::chrono::steady_clock::now() - blockStart;
+    double period = numFrames / sampleRate;
+    double instant = spent.count() / period;
+
+    // peak follower: spikes count at once, calm returns slowly
+    if (instant > load)
+        load = instant;
+    else
+        load += (instant - load) * (1.0 - exp(-period / LOAD_RELEASE_SECONDS));
+
+    if (xrun)
+        xruns++;
+
+    // an xrun is an overload even if this callback was fast
+    bool overload = xrun || load > LOAD_HIGH;
+
+    holdTime += period;
+    if (!xrun && load < LOAD_LOW)
+        calmTime += period;
+    else
+        calmTime = 0.0;
+
+    if (overload && level < NUM_LOAD_LEVELS - 1 && holdTime >= LOAD_HOLD_SECONDS) {
+        level++;
+        holdTime = 0.0;
+    }
+    else if (level > LOAD_FULL && calmTime >= LOAD_RECOVER_SECONDS) {
+        level--;
+        calmTime = 0.0;
+    }
+}
+
+
+//-----------------------------------------------------------------------------
+// Limits
+//-----------------------------------------------------------------------------
+int LoadGovernor::getLevel()
+{
+    return level;
+}
+
+int LoadGovernor::maxInterpolation()
+{
+    if (level >= LOAD_LINEAR)
+        return INTERP_LINEAR;
+    if (level >= LOAD_HERMITE)
+        return INTERP_HERMITE;
+    return NUM_INTERP_TYPES - 1;
+}
+
+double LoadGovernor::voiceScale()
+{
+    return (level >= LOAD_FEWER_VOICES) ? 0.5 : 1.0;
+}
+
+double LoadGovernor::densityScale(bool background)
+{
+    return (background && level >= LOAD_SPARSE_BACKGROUND) ? 0.5 : 1.0;
+}
+
+
+//-----------------------------------------------------------------------------
+// Statistics
+//-----------------------------------------------------------------------------
+double LoadGovernor::getLoad()
+{
+    return load;
+}
+
+unsigned long LoadGovernor::getXruns()
+{
+    return xruns;
+}
@@ -0,0 +1,91 @@
+//------------------------------------------------------------------------------
+// FRONTIÈRES:  An interactive granular sampler.
+//------------------------------------------------------------------------------
+// More information is available at
+//     http::/ccrma.stanford.edu/~carlsonc/256a/Borderlands/index.html
+//
+//
+// Copyright (C) 2018  Jean Pierre Cimalando
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 3.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+
+//
+//  LoadGovernor.h
+//  Frontières
+//
+//  Watches the time the audio callback takes against the buffer period,
+//  and the xruns, and lowers the quality in steps while the engine is
+//  overloaded, so that the sound degrades a little instead of dropping out.
+//
+
+#ifndef LOADGOVERNOR_H
+#define LOADGOVERNOR_H
+
+#include <chrono>
+
+// degradation steps, each one keeps the limits of the previous ones
+enum {
+    LOAD_FULL,  // full quality
+    LOAD_HERMITE,  // interpolation at most HERMITE
+    LOAD_LINEAR,  // interpolation at most LINEAR
+    LOAD_FEWER_VOICES,  // clouds play half as many grains at once
+    LOAD_SPARSE_BACKGROUND,  // clouds not selected trigger at half the rate
+    NUM_LOAD_LEVELS
+};
+
+class LoadGovernor {
+
+public:
+    // destructor
+    ~LoadGovernor();
+
+    // constructor
+    LoadGovernor(unsigned int sampleRate);
+
+    // around the work of each callback, with whether the device reported
+    // an xrun since the last one
+    void beginBlock();
+    void endBlock(unsigned int numFrames, bool xrun);
+
+    // current step
+    int getLevel();
+
+    // limits of the step: best interpolation of the sounds, and fractions
+    // of the grains a cloud plays at once and of its trigger rate
+    int maxInterpolation();
+    double voiceScale();
+    double densityScale(bool background);
+
+    // smoothed fraction of the buffer period spent in the callback
+    double getLoad();
+    // xruns reported so far
+    unsigned long getXruns();
+
+private:
+    double sampleRate;
+
+    // when the current callback started
+    std::chrono::steady_clock::time_point blockStart;
+
+    double load;
+    int level;
+    unsigned long xruns;
+
+    // time since the last step down, and time spent under the low mark (s)
+    double holdTime;
+    double calmTime;
+};
+
+#endif
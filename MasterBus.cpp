@@ -0,0 +1,206 @@
+//------------------------------------------------------------------------------
+// FRONTIÈRES:  An interactive granular sampler.
+//------------------------------------------------------------------------------
+// More information is available at
+//     http::/ccrma.stanford.edu/~carlsonc/256a/Borderlands/index.html
+//
+//
+// Copyright (C) 2018  Jean Pierre Cimalando
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 3.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+//
+//  MasterBus.cpp
+//  Frontières
+//
+
+#include "MasterBus.h"
+#include <math.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#if defined(__AVX__)
+#include <immintrin.h>
+#endif
+
+// cutoff of the DC blocker (Hz)
+#define MASTER_DC_CUTOFF 10.0
+// level above which the clipper bends the signal
+#define MASTER_CLIP_KNEE 0.8
+
+
+//-----------------------------------------------------------------------------
+// Constructor / destructor
+//-----------------------------------------------------------------------------
+MasterBus::~MasterBus()
+{
+}
+
+MasterBus::MasterBus(unsigned int sampleRate)
+{
+    dcPole = 1.0 - 2.0 * M_PI * MASTER_DC_CUTOFF / sampleRate;
+    for (int k = 0; k < MY_CHANNELS; k++) {
+        dcLastIn[k] = 0.0;
+        dcLastOut[k] = 0.0;
+    }
+
+    gainDb = 0.0;
+    gain = 1.0;
+    targetGain = 1.0;
+}
+
+
+//-----------------------------------------------------------------------------
+// Output gain
+//-----------------------------------------------------------------------------
+void MasterBus::setGainDb(double theGainDb)
+{
+    if (theGainDb > 12.0)
+        theGainDb = 12.0;
+    gainDb = theGainDb;
+    targetGain = pow(10.0, gainDb / 20.0);
+}
+
+double MasterBus::getGainDb()
+{
+    return gainDb;
+}
+
+
+//-----------------------------------------------------------------------------
+// Processing
+//-----------------------------------------------------------------------------
+void MasterBus::process(SAMPLE *buff, unsigned int numFrames)
+{
+    dcBlock(buff, numFrames);
+    applyGain(buff, numFrames);
+    softClip(buff, numFrames);
+}
+
+void MasterBus::dcBlock(SAMPLE *buff, unsigned int numFrames)
+{
+    // y[n] = x[n] - x[n-1] + R * y[n-1]
+#if MY_CHANNELS == 2 && defined(__SSE2__)
+    // lanes hold the L/R pair of a frame
+    const __m128d r = _mm_set1_pd(dcPole);
+    __m128d x1 = _mm_loadu_pd(dcLastIn);
+    __m128d y1 = _mm_loadu_pd(dcLastOut);
+    for (unsigned int i = 0; i < numFrames; i++) {
+        __m128d x = _mm_loadu_pd(&buff[2 * i]);
+        y1 = _mm_add_pd(_mm_sub_pd(x, x1), _mm_mul_pd(r, y1));
+        x1 = x;
+        _mm_storeu_pd(&buff[2 * i], y1);
+    }
+    _mm_storeu_pd(dcLastIn, x1);
+    _mm_storeu_pd(dcLastOut, y1);
+#else
+    for (int k = 0; k < MY_CHANNELS; k++) {
+        double x1 = dcLastIn[k], y1 = dcLastOut[k];
+        for (unsigned int i = 0; i < numFrames; i++) {
+            double x = buff[i * MY_CHANNELS + k];
+            y1 = x - x1 + dcPole * y1;
+            x1 = x;
+            buff[i * MY_CHANNELS + k] = y1;
+        }
+        dcLastIn[k] = x1;
+        dcLastOut[k] = y1;
+    }
+#endif
+}
+
+void MasterBus::applyGain(SAMPLE *buff, unsigned int numFrames)
+{
+    if (numFrames == 0)
+        return;
+
+    // ramp linearly to the target over the block
+    double target = targetGain.load();
+    double g = gain;
+    double dg = (target - gain) / numFrames;
+    for (unsigned int i = 0; i < numFrames; i++) {
+        g += dg;
+        for (int k = 0; k < MY_CHANNELS; k++)
+            buff[i * MY_CHANNELS + k] *= g;
+    }
+    gain = target;
+}
+
+void MasterBus::softClip(SAMPLE *buff, unsigned int numFrames)
+{
+    // linear below the knee.  above, the excess goes through a rational
+    // approximation of tanh, which reaches full scale at 3 times the
+    // headroom and stays there.
+    const double knee = MASTER_CLIP_KNEE;
+    const double room = 1.0 - knee;
+    unsigned int count = numFrames * MY_CHANNELS;
+    unsigned int i = 0;
+
+#if defined(__AVX__)
+    const __m256d vknee4 = _mm256_set1_pd(knee);
+    const __m256d vroom4 = _mm256_set1_pd(room);
+    const __m256d vinvroom4 = _mm256_set1_pd(1.0 / room);
+    const __m256d zero4 = _mm256_setzero_pd();
+    const __m256d three4 = _mm256_set1_pd(3.0);
+    const __m256d c27_4 = _mm256_set1_pd(27.0);
+    const __m256d c9_4 = _mm256_set1_pd(9.0);
+    const __m256d signMask4 = _mm256_set1_pd(-0.0);
+    for (; i + 4 <= count; i += 4) {
+        __m256d x = _mm256_loadu_pd(&buff[i]);
+        __m256d sign = _mm256_and_pd(x, signMask4);
+        __m256d a = _mm256_andnot_pd(signMask4, x);
+        __m256d u = _mm256_mul_pd(_mm256_max_pd(_mm256_sub_pd(a, vknee4), zero4),
+                                  vinvroom4);
+        u = _mm256_min_pd(u, three4);
+        __m256d u2 = _mm256_mul_pd(u, u);
+        __m256d t = _mm256_div_pd(_mm256_mul_pd(u, _mm256_add_pd(c27_4, u2)),
+                                  _mm256_add_pd(c27_4, _mm256_mul_pd(c9_4, u2)));
+        __m256d y = _mm256_add_pd(_mm256_min_pd(a, vknee4), _mm256_mul_pd(t, vroom4));
+        _mm256_storeu_pd(&buff[i], _mm256_or_pd(y, sign));
+    }
+#endif
+#if defined(__SSE2__)
+    const __m128d vknee = _mm_set1_pd(knee);
+    const __m128d vroom = _mm_set1_pd(room);
+    const __m128d vinvroom = _mm_set1_pd(1.0 / room);
+    const __m128d zero = _mm_setzero_pd();
+    const __m128d three = _mm_set1_pd(3.0);
+    const __m128d c27 = _mm_set1_pd(27.0);
+    const __m128d c9 = _mm_set1_pd(9.0);
+    const __m128d signMask = _mm_set1_pd(-0.0);
+    for (; i + 2 <= count; i += 2) {
+        __m128d x = _mm_loadu_pd(&buff[i]);
+        __m128d sign = _mm_and_pd(x, signMask);
+        __m128d a = _mm_andnot_pd(signMask, x);
+        __m128d u = _mm_mul_pd(_mm_max_pd(_mm_sub_pd(a, vknee), zero), vinvroom);
+        u = _mm_min_pd(u, three);
+        __m128d u2 = _mm_mul_pd(u, u);
+        __m128d t = _mm_div_pd(_mm_mul_pd(u, _mm_add_pd(c27, u2)),
+                               _mm_add_pd(c27, _mm_mul_pd(c9, u2)));
+        __m128d y = _mm_add_pd(_mm_min_pd(a, vknee), _mm_mul_pd(t, vroom));
+        _mm_storeu_pd(&buff[i], _mm_or_pd(y, sign));
+    }
+#endif
+    for (; i < count; i++) {
+        double x = buff[i];
+        double a = fabs(x);
+        if (a <= knee)
+            continue;
+        double u = (a - knee) / room;
+        if (u > 3.0)
+            u = 3.0;
+        double t = u * (27.0 + u * u) / (27.0 + 9.0 * u * u);
+        buff[i] = copysign(knee + t * room, x);
+    }
+}
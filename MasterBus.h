@@ -0,0 +1,74 @@
+//------------------------------------------------------------------------------
+// FRONTIÈRES:  An interactive granular sampler.
+//------------------------------------------------------------------------------
+// More information is available at
+//     http::/ccrma.stanford.edu/~carlsonc/256a/Borderlands/index.html
+//
+//
+// Copyright (C) 2018  Jean Pierre Cimalando
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 3.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+//
+//  MasterBus.h
+//  Frontières
+//
+//  Last stage of the output, run once per block after all clouds have
+//  rendered: DC blocker, output gain and soft clipper.
+//
+
+#ifndef MASTERBUS_H
+#define MASTERBUS_H
+
+#include "theglobals.h"
+#include <atomic>
+
+class MasterBus {
+
+public:
+    // destructor
+    ~MasterBus();
+
+    // constructor
+    MasterBus(unsigned int sampleRate);
+
+    // output gain, in dB (ramped over one block when it changes).  set by
+    // the GUI, the audio thread only sees the linear target.
+    void setGainDb(double theGainDb);
+    double getGainDb();
+
+    // process a block of interleaved frames in place
+    void process(SAMPLE *buff, unsigned int numFrames);
+
+protected:
+    // remove the DC offset of each channel
+    void dcBlock(SAMPLE *buff, unsigned int numFrames);
+    // apply the gain, from the current one to the target one
+    void applyGain(SAMPLE *buff, unsigned int numFrames);
+    // saturate smoothly above the knee, up to full scale
+    void softClip(SAMPLE *buff, unsigned int numFrames);
+
+private:
+    // DC blocker: pole, and last input and output of each channel
+    double dcPole;
+    double dcLastIn[MY_CHANNELS];
+    double dcLastOut[MY_CHANNELS];
+
+    // gain in dB (GUI), linear gain applied (audio), and the one aimed for
+    double gainDb;
+    double gain;
+    std::atomic<double> targetGain;
+};
+
+#endif
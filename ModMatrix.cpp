@@ -0,0 +1,221 @@
+//------------------------------------------------------------------------------
+// FRONTIÈRES:  An interactive granular sampler.
+//------------------------------------------------------------------------------
+// More information is available at
+//     http::/ccrma.stanford.edu/~carlsonc/256a/Borderlands/index.html
+//
+//
+// Copyright (C) 2018  Jean Pierre Cimalando
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 3.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+
+//
+//  ModMatrix.cpp
+//  Frontières
+//
+
+#include "ModMatrix.h"
+#include <math.h>
+
+extern unsigned int samp_rate;
+
+// time constant of the smoothing of the targets (s)
+#define MOD_SMOOTH_SECONDS 0.02
+
+
+//-----------------------------------------------------------------------------
+// Settings
+//-----------------------------------------------------------------------------
+ModSettings::ModSettings()
+{
+    for (int i = 0; i < MOD_NUM_LFOS; i++) {
+        lfoShape[i] = LFO_SINE;
+        lfoFreq[i] = 0.0;
+    }
+    for (int i = 0; i < MOD_NUM_ENVS; i++) {
+        envAttack[i] = 0.0;
+        envDecay[i] = 1.0;
+    }
+    for (int i = 0; i < MOD_MAX_ROUTES; i++)
+        setRoute(i, -1, 0, 0.0);
+}
+
+void ModSettings::setLFO(unsigned int idx, int shape, double freq)
+{
+    if (idx >= MOD_NUM_LFOS)
+        return;
+    if (shape >= 0 && shape < NUM_LFO_SHAPES)
+        lfoShape[idx] = shape;
+    lfoFreq[idx] = fabs(freq);
+}
+
+void ModSettings::setLFOFreq(unsigned int idx, double freq)
+{
+    if (idx < MOD_NUM_LFOS)
+        lfoFreq[idx] = fabs(freq);
+}
+
+int ModSettings::getLFOShape(unsigned int idx) const
+{
+    return (idx < MOD_NUM_LFOS) ? lfoShape[idx] : LFO_SINE;
+}
+
+double ModSettings::getLFOFreq(unsigned int idx) const
+{
+    return (idx < MOD_NUM_LFOS) ? lfoFreq[idx] : 0.0;
+}
+
+void ModSettings::setEnvelope(unsigned int idx, double attack, double decay)
+{
+    if (idx >= MOD_NUM_ENVS)
+        return;
+    envAttack[idx] = fmax(attack, 0.0);
+    envDecay[idx] = fmax(decay, 0.0);
+}
+
+void ModSettings::setRoute(unsigned int slot, int source, int target, double depth)
+{
+    if (slot >= MOD_MAX_ROUTES)
+        return;
+    // a route is either valid or entirely free, the evaluation indexes the
+    // targets with it
+    if (source < 0 || source >= NUM_MOD_SOURCES || target < 0 || target >= NUM_MOD_TARGETS) {
+        source = -1;
+        target = 0;
+        depth = 0.0;
+    }
+    routes[slot].source = source;
+    routes[slot].target = target;
+    routes[slot].depth = depth;
+}
+
+ModRoute ModSettings::getRoute(unsigned int slot) const
+{
+    return routes[(slot < MOD_MAX_ROUTES) ? slot : 0];
+}
+
+bool ModSettings::modulates(int target) const
+{
+    for (int r = 0; r < MOD_MAX_ROUTES; r++) {
+        const ModRoute &route = routes[r];
+        if (route.source == -1 || route.target != target || route.depth == 0.0)
+            continue;
+        // an LFO which doesn't run holds a constant
+        if (route.source < MOD_ENV1 && lfoFreq[route.source - MOD_LFO1] == 0.0)
+            continue;
+        return true;
+    }
+    return false;
+}
+
+
+//-----------------------------------------------------------------------------
+// Constructor / destructor
+//-----------------------------------------------------------------------------
+ModMatrix::~ModMatrix()
+{
+}
+
+ModMatrix::ModMatrix()
+{
+    for (int i = 0; i < MOD_NUM_LFOS; i++) {
+        lfoPhase[i] = 0.0;
+        lfoHeld[i] = 0.0;
+    }
+    for (int i = 0; i < MOD_NUM_ENVS; i++)
+        envTime[i] = -1.0;
+    for (int i = 0; i < NUM_MOD_SOURCES; i++)
+        sources[i] = 0.0;
+    for (int i = 0; i < NUM_MOD_TARGETS; i++)
+        targets[i] = 0.0;
+}
+
+void ModMatrix::triggerEnvelopes()
+{
+    for (int i = 0; i < MOD_NUM_ENVS; i++)
+        envTime[i] = 0.0;
+}
+
+
+//-----------------------------------------------------------------------------
+// Evaluation, once per block
+//-----------------------------------------------------------------------------
+void ModMatrix::process(const ModSettings &settings, unsigned int numFrames,
+                        Random *rng)
+{
+    double dt = numFrames / (double)::samp_rate;
+
+    // all sources at the start of the block
+    for (int i = 0; i < MOD_NUM_LFOS; i++) {
+        double phase = lfoPhase[i];
+        double x;
+        switch (settings.lfoShape[i]) {
+        case LFO_TRIANGLE:
+            x = 1.0 - 4.0 * fabs(phase - 0.5);
+            break;
+        case LFO_SAMPLE_HOLD:
+            x = lfoHeld[i];
+            break;
+        default:
+            x = sin(2.0 * M_PI * phase);
+            break;
+        }
+        // a stopped LFO is silent
+        sources[MOD_LFO1 + i] = (settings.lfoFreq[i] > 0.0) ? x : 0.0;
+
+        phase += settings.lfoFreq[i] * dt;
+        if (phase >= 1.0) {
+            phase -= floor(phase);
+            lfoHeld[i] = 2.0 * rng->uniform() - 1.0;
+        }
+        lfoPhase[i] = phase;
+    }
+
+    for (int i = 0; i < MOD_NUM_ENVS; i++) {
+        double t = envTime[i];
+        double x = 0.0;
+        double attack = settings.envAttack[i];
+        double decay = settings.envDecay[i];
+        if (t >= 0.0) {
+            if (t < attack)
+                x = t / attack;
+            else if (t - attack < decay)
+                x = 1.0 - (t - attack) / decay;
+            else
+                envTime[i] = -1.0;
+        }
+        sources[MOD_ENV1 + i] = x;
+        if (envTime[i] >= 0.0)
+            envTime[i] += dt;
+    }
+
+    // sum the routes, and glide to the result
+    double raw[NUM_MOD_TARGETS];
+    for (int i = 0; i < NUM_MOD_TARGETS; i++)
+        raw[i] = 0.0;
+    for (int r = 0; r < MOD_MAX_ROUTES; r++) {
+        const ModRoute &route = settings.routes[r];
+        if (route.source != -1)
+            raw[route.target] += route.depth * sources[route.source];
+    }
+
+    double a = 1.0 - exp(-dt / MOD_SMOOTH_SECONDS);
+    for (int i = 0; i < NUM_MOD_TARGETS; i++) {
+        targets[i] += a * (raw[i] - targets[i]);
+        // land exactly, so that a route taken away leaves the parameter as set
+        if (fabs(raw[i] - targets[i]) < 1e-9)
+            targets[i] = raw[i];
+    }
+}
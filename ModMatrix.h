@@ -0,0 +1,145 @@
+//------------------------------------------------------------------------------
+// FRONTIÈRES:  An interactive granular sampler.
+//------------------------------------------------------------------------------
+// More information is available at
+//     http::/ccrma.stanford.edu/~carlsonc/256a/Borderlands/index.html
+//
+//
+// Copyright (C) 2018  Jean Pierre Cimalando
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 3.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+
+//
+//  ModMatrix.h
+//  Frontières
+//
+//  Modulation of the parameters of a cloud: LFOs and envelopes evaluated
+//  together once per audio block, summed into the parameters through a
+//  list of routes, and smoothed over the blocks.  The settings are a plain
+//  value the GUI edits and hands over with the other parameters of the
+//  cloud; the running state belongs to the audio thread.
+//
+
+#ifndef MODMATRIX_H
+#define MODMATRIX_H
+
+#include "Random.h"
+
+// modulation sources
+enum {
+    MOD_LFO1,
+    MOD_LFO2,
+    MOD_LFO3,
+    MOD_LFO4,
+    MOD_ENV1,
+    MOD_ENV2,
+    NUM_MOD_SOURCES
+};
+
+enum { MOD_NUM_LFOS = MOD_ENV1 - MOD_LFO1, MOD_NUM_ENVS = NUM_MOD_SOURCES - MOD_ENV1 };
+
+// shapes of the LFOs, from -1 to 1
+enum {
+    LFO_SINE,
+    LFO_TRIANGLE,
+    LFO_SAMPLE_HOLD,  // new random value at each period
+    NUM_LFO_SHAPES
+};
+
+// modulated parameters, and the unit of the modulation
+enum {
+    MOD_DURATION,  // octaves of grain duration
+    MOD_OVERLAP,  // added to the normalized overlap
+    MOD_VOLUME,  // dB of volume
+    MOD_SPREAD,  // factor of the position spread, minus 1
+    MOD_PITCH,  // added to the playback rate
+    NUM_MOD_TARGETS
+};
+
+// connections of the matrix
+enum { MOD_MAX_ROUTES = 8 };
+
+struct ModRoute {
+    // source, or -1 if the route is free
+    int source;
+    int target;
+    double depth;
+};
+
+// sources and routes of the matrix, as set by the GUI
+struct ModSettings {
+    // constructor: LFOs stopped, no routes
+    ModSettings();
+
+    // LFO shape and frequency (Hz)
+    void setLFO(unsigned int idx, int shape, double freq);
+    void setLFOFreq(unsigned int idx, double freq);
+    int getLFOShape(unsigned int idx) const;
+    double getLFOFreq(unsigned int idx) const;
+
+    // attack/decay envelopes (s), which start at ModMatrix::triggerEnvelopes()
+    void setEnvelope(unsigned int idx, double attack, double decay);
+
+    // route of a slot (source -1 to clear it, as does a source or target
+    // out of range)
+    void setRoute(unsigned int slot, int source, int target, double depth);
+    ModRoute getRoute(unsigned int slot) const;
+
+    // whether some route acts on a target
+    bool modulates(int target) const;
+
+    int lfoShape[MOD_NUM_LFOS];
+    double lfoFreq[MOD_NUM_LFOS];
+    double envAttack[MOD_NUM_ENVS];
+    double envDecay[MOD_NUM_ENVS];
+    ModRoute routes[MOD_MAX_ROUTES];
+};
+
+class ModMatrix {
+
+public:
+    // destructor
+    ~ModMatrix();
+
+    // constructor
+    ModMatrix();
+
+    // start the envelopes from their attack
+    void triggerEnvelopes();
+
+    // advance by a block of frames and update the modulation of the targets
+    void process(const ModSettings &settings, unsigned int numFrames, Random *rng);
+
+    // modulation of a target, in its unit
+    double value(int target)
+    {
+        return targets[target];
+    }
+
+private:
+    // LFOs: phase in periods, and held random value
+    double lfoPhase[MOD_NUM_LFOS];
+    double lfoHeld[MOD_NUM_LFOS];
+
+    // envelopes: time since the trigger (negative while idle)
+    double envTime[MOD_NUM_ENVS];
+
+    // values of the sources in this block, and smoothed modulation of the
+    // targets
+    double sources[NUM_MOD_SOURCES];
+    double targets[NUM_MOD_TARGETS];
+};
+
+#endif
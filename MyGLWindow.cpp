@@ -23,6 +23,9 @@
 #include "Frontieres.h"
 #include "SoundRect.h"
 #include "GrainCluster.h"
+#include "CommandQueue.h"
+#include "Reclaimer.h"
+#include "Scene.h"
 #include <QtFont3D.h>
 #include <QMouseEvent>
 #include <QKeyEvent>
@@ -104,6 +107,18 @@ void MyGLScreen::initializeGL()
 
 void MyGLScreen::paintGL()
 {
+    // grains triggered by the audio thread since the last frame
+    GrainTrigger trigger;
+    while (theScene && theScene->nextTrigger(&trigger)) {
+        for (int i = 0; i < grainCloud->size(); i++) {
+            if (grainCloud->at(i)->getId() == trigger.cloudId) {
+                grainCloudVis->at(i)->showGrain(trigger.grain, trigger.x, trigger.y,
+                                                trigger.duration, trigger.sounds);
+                break;
+            }
+        }
+    }
+
     // clear color and depth buffers
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
     glClearDepth(1.0);
@@ -123,10 +138,12 @@ void MyGLScreen::paintGL()
             }
         }
 
-        // render grain clouds if they exist
+        // render grain clouds if they exist, and let the audio know which
+        // one is selected
         if (grainCloudVis) {
             for (int i = 0; i < grainCloudVis->size(); i++) {
                 grainCloudVis->at(i)->draw();
+                grainCloud->at(i)->setSelected(i == selectedCloud);
             }
         }
 
@@ -243,6 +260,7 @@ void MyGLScreen::mouseMoveEvent(QMouseEvent *event)
 
     if (selectedCloud >= 0) {
         grainCloudVis->at(selectedCloud)->updateCloudPosition(mouseX, mouseY);
+        grainCloud->at(selectedCloud)->updateGeometry();
     }
     else {
 
@@ -252,6 +270,7 @@ void MyGLScreen::mouseMoveEvent(QMouseEvent *event)
 
                 if (selectedRect >= 0) {  // movement case
                     soundViews->at(selectedRect)->move(mouseX - lastDragX, mouseY - lastDragY);
+                    theScene->publish(*soundViews);
                 }
             }
             lastDragX = mouseX;
@@ -293,6 +312,7 @@ void MyGLScreen::mouseMoveEvent(QMouseEvent *event)
 
                     // update width and height
                     soundViews->at(selectedRect)->setWidthHeight(newWidth, newHeight);
+                    theScene->publish(*soundViews);
                 }
             }
             lastDragX = x;
@@ -315,12 +335,15 @@ void MyGLScreen::mousePassiveMoveEvent(QMouseEvent *event)
         switch (currentParam) {
         case MOTIONX:
             grainCloudVis->at(selectedCloud)->setXRandExtent(mouseX);
+            grainCloud->at(selectedCloud)->updateGeometry();
             break;
         case MOTIONY:
             grainCloudVis->at(selectedCloud)->setYRandExtent(mouseY);
+            grainCloud->at(selectedCloud)->updateGeometry();
             break;
         case MOTIONXY:
             grainCloudVis->at(selectedCloud)->setRandExtent(mouseX, mouseY);
+            grainCloud->at(selectedCloud)->updateGeometry();
             break;
         default:
             break;
@@ -417,15 +440,35 @@ void MyGLScreen::keyPressEvent(QKeyEvent *event)
         break;
     case Qt::Key_7:
         paramString.push_back('7');
+        if (currentParam == WINDOW) {
+            if (selectedCloud >= 0) {
+                grainCloud->at(selectedCloud)->setWindowType(6);
+            }
+        }
         break;
     case Qt::Key_8:
         paramString.push_back('8');
+        if (currentParam == WINDOW) {
+            if (selectedCloud >= 0) {
+                grainCloud->at(selectedCloud)->setWindowType(7);
+            }
+        }
         break;
     case Qt::Key_9:
         paramString.push_back('9');
+        if (currentParam == WINDOW) {
+            if (selectedCloud >= 0) {
+                grainCloud->at(selectedCloud)->setWindowType(8);
+            }
+        }
         break;
     case Qt::Key_0:
         paramString.push_back('0');
+        if (currentParam == WINDOW) {
+            if (selectedCloud >= 0) {
+                grainCloud->at(selectedCloud)->setWindowType(RANDOM_WIN);
+            }
+        }
         break;
     case Qt::Key_Period:
         paramString.push_back('.');
@@ -466,6 +509,21 @@ void MyGLScreen::keyPressEvent(QKeyEvent *event)
                 }
                 break;
 
+            case WINDOW_PARAM:
+                if (selectedCloud >= 0) {
+                    grainCloud->at(selectedCloud)->setWindowParam(value);
+                }
+                break;
+            case WINDOW_LENGTH:
+                if (selectedCloud >= 0) {
+                    if (value > WINDOW_MAX_LEN) {
+                        value = WINDOW_MAX_LEN;
+                    }
+                    if (value >= 1.0) {
+                        grainCloud->at(selectedCloud)->setWindowLength((unsigned int)value);
+                    }
+                }
+                break;
             case VOLUME:
                 if (selectedCloud >= 0) {
                     grainCloud->at(selectedCloud)->setVolumeDb(value);
@@ -566,6 +624,7 @@ void MyGLScreen::keyPressEvent(QKeyEvent *event)
         }
         if (selectedRect >= 0) {
             soundViews->at(selectedRect)->toggleOrientation();
+            theScene->publish(*soundViews);
         }
         // cerr << "Looking from the front" << endl;
         break;
@@ -597,6 +656,53 @@ void MyGLScreen::keyPressEvent(QKeyEvent *event)
 
         break;
 
+    case Qt::Key_E:  // parameter of the window shape / length of its table
+        paramString = "";
+        if (modkey == Qt::ShiftModifier) {
+            currentParam = WINDOW_LENGTH;
+        }
+        else if (currentParam != WINDOW_PARAM) {
+            currentParam = WINDOW_PARAM;
+        }
+        break;
+
+    case Qt::Key_I:  // interpolation quality of the sounds
+        paramString = "";
+        if (currentParam != INTERPOLATION) {
+            currentParam = INTERPOLATION;
+        }
+        else {
+            if (selectedCloud >= 0) {
+                int theInterp = grainCloud->at(selectedCloud)->getInterpolation();
+                if (modkey == Qt::ShiftModifier)
+                    grainCloud->at(selectedCloud)->setInterpolation(theInterp - 1);
+                else
+                    grainCloud->at(selectedCloud)->setInterpolation(theInterp + 1);
+            }
+        }
+        break;
+
+    case Qt::Key_H:
+        // freeze the cloud into a loop / back to live grains
+        paramString = "";
+        if (selectedCloud >= 0) {
+            GrainCluster *theCloud = grainCloud->at(selectedCloud);
+            if (theCloud->isFrozen())
+                theCloud->unfreeze();
+            else
+                theCloud->freeze();
+        }
+        break;
+
+    case Qt::Key_M:
+        // master volume
+        paramString = "";
+        if (modkey == Qt::ShiftModifier)
+            masterBus->setGainDb(masterBus->getGainDb() - 0.5);
+        else
+            masterBus->setGainDb(masterBus->getGainDb() + 0.5);
+        break;
+
     case Qt::Key_B:
         // cloud volume
         paramString = "";
@@ -631,7 +737,10 @@ void MyGLScreen::keyPressEvent(QKeyEvent *event)
         deselect(RECT);
         if (grainCloud != NULL) {
             if (modkey == Qt::ShiftModifier) {
-                if (grainCloud->size() > 0) {
+                // deleted once the audio thread cannot see it anymore
+                if (grainCloud->size() > 0 && engineCommands->canPost()) {
+                    engineCommands->post(CMD_REMOVE_CLOUD, grainCloud->back());
+                    reclaimer->retire(grainCloud->back());
                     grainCloud->pop_back();
                     grainCloudVis->pop_back();
                     numClouds -= 1;
@@ -647,7 +756,7 @@ void MyGLScreen::keyPressEvent(QKeyEvent *event)
                 }
                 break;
             }
-            else {
+            else if (grainCloud->size() < MAX_CLOUDS && engineCommands->canPost()) {
                 int numVoices = 8;  // initial number of voices
                 int idx = grainCloud->size();
                 if (selectedCloud >= 0) {
@@ -657,7 +766,7 @@ void MyGLScreen::keyPressEvent(QKeyEvent *event)
                 }
                 selectedCloud = idx;
                 // create audio
-                grainCloud->push_back(new GrainCluster(mySounds, numVoices));
+                grainCloud->push_back(new GrainCluster(mySounds, voicePool, theScene, engineCommands, numVoices));
                 // create visualization
                 grainCloudVis->push_back(
                     new GrainClusterVis(mouseX, mouseY, numVoices, soundViews));
@@ -666,6 +775,8 @@ void MyGLScreen::keyPressEvent(QKeyEvent *event)
                 // register visualization with audio
                 grainCloud->at(idx)->registerVis(grainCloudVis->at(idx));
                 // grainCloud->at(idx)->toggleActive();
+                // start playing it
+                engineCommands->post(CMD_ADD_CLOUD, grainCloud->at(idx));
                 numClouds += 1;
             }
             //                        cout << "cloud added" << endl;
@@ -681,15 +792,19 @@ void MyGLScreen::keyPressEvent(QKeyEvent *event)
         else {
             if (modkey == Qt::ShiftModifier) {
                 if (selectedCloud >= 0) {
-                    if (grainCloud)
-                        grainCloud->at(selectedCloud)->removeGrain();
+                    if (grainCloud && engineCommands->post(CMD_REMOVE_GRAIN, grainCloud->at(selectedCloud))) {
+                        grainCloud->at(selectedCloud)->unfreeze();
+                        grainCloudVis->at(selectedCloud)->removeGrain();
+                    }
                     // cout << "grain removed" << endl;
                 }
             }
             else {
                 if (selectedCloud >= 0) {
-                    if (grainCloud)
-                        grainCloud->at(selectedCloud)->addGrain();
+                    if (grainCloud && engineCommands->post(CMD_ADD_GRAIN, grainCloud->at(selectedCloud))) {
+                        grainCloud->at(selectedCloud)->unfreeze();
+                        grainCloudVis->at(selectedCloud)->addGrain();
+                    }
                     // cout << "grain added" << endl;
                 }
             }
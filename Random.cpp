@@ -0,0 +1,124 @@
+//------------------------------------------------------------------------------
+// FRONTIÈRES:  An interactive granular sampler.
+//------------------------------------------------------------------------------
+// More information is available at
+//     http::/ccrma.stanford.edu/~carlsonc/256a/Borderlands/index.html
+//
+//
+// Copyright (C) 2018  Jean Pierre Cimalando
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 3.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+
+//
+//  Random.cpp
+//  Frontières
+//
+
+#include "Random.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+
+//-----------------------------------------------------------------------------
+// Constructor / seeding
+//-----------------------------------------------------------------------------
+Random::Random(uint64_t theSeed)
+{
+    seed(theSeed);
+}
+
+void Random::seed(uint64_t theSeed)
+{
+    // the state is expanded from the seed with splitmix64, which never
+    // leaves a stream all zero
+    uint64_t x = theSeed;
+    for (int i = 0; i < 16; i += 2) {
+        uint64_t z = (x += 0x9e3779b97f4a7c15ull);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+        z ^= z >> 31;
+        state[i / 4][i % 4] = (uint32_t)z;
+        state[(i + 1) / 4][(i + 1) % 4] = (uint32_t)(z >> 32);
+    }
+
+    next = RANDOM_BLOCK;
+}
+
+
+//-----------------------------------------------------------------------------
+// Batch generation
+//-----------------------------------------------------------------------------
+void Random::fill(float *out, unsigned int n)
+{
+    // the upper 24 bits of the sum make the float
+    const float scale = 1.0f / 16777216.0f;
+
+#if defined(__SSE2__)
+    __m128i s0 = _mm_loadu_si128((const __m128i *)state[0]);
+    __m128i s1 = _mm_loadu_si128((const __m128i *)state[1]);
+    __m128i s2 = _mm_loadu_si128((const __m128i *)state[2]);
+    __m128i s3 = _mm_loadu_si128((const __m128i *)state[3]);
+    const __m128 vscale = _mm_set1_ps(scale);
+
+    unsigned int i = 0;
+    while (i < n) {
+        __m128i r = _mm_add_epi32(s0, s3);
+        __m128i t = _mm_slli_epi32(s1, 9);
+        s2 = _mm_xor_si128(s2, s0);
+        s3 = _mm_xor_si128(s3, s1);
+        s1 = _mm_xor_si128(s1, s2);
+        s0 = _mm_xor_si128(s0, s3);
+        s2 = _mm_xor_si128(s2, t);
+        s3 = _mm_or_si128(_mm_slli_epi32(s3, 11), _mm_srli_epi32(s3, 21));
+
+        __m128 f = _mm_mul_ps(_mm_cvtepi32_ps(_mm_srli_epi32(r, 8)), vscale);
+        if (n - i >= 4) {
+            _mm_storeu_ps(&out[i], f);
+            i += 4;
+        }
+        else {
+            float last[4];
+            _mm_storeu_ps(last, f);
+            for (int k = 0; i < n; k++)
+                out[i++] = last[k];
+        }
+    }
+
+    _mm_storeu_si128((__m128i *)state[0], s0);
+    _mm_storeu_si128((__m128i *)state[1], s1);
+    _mm_storeu_si128((__m128i *)state[2], s2);
+    _mm_storeu_si128((__m128i *)state[3], s3);
+#else
+    unsigned int i = 0;
+    while (i < n) {
+        // the same four streams, one after the other
+        for (int k = 0; k < 4; k++) {
+            uint32_t r = state[0][k] + state[3][k];
+            uint32_t t = state[1][k] << 9;
+            state[2][k] ^= state[0][k];
+            state[3][k] ^= state[1][k];
+            state[1][k] ^= state[2][k];
+            state[0][k] ^= state[3][k];
+            state[2][k] ^= t;
+            state[3][k] = (state[3][k] << 11) | (state[3][k] >> 21);
+            if (i + k < n)
+                out[i + k] = (float)(r >> 8) * scale;
+        }
+        i += 4;
+    }
+#endif
+}
@@ -0,0 +1,74 @@
+//------------------------------------------------------------------------------
+// FRONTIÈRES:  An interactive granular sampler.
+//------------------------------------------------------------------------------
+// More information is available at
+//     http::/ccrma.stanford.edu/~carlsonc/256a/Borderlands/index.html
+//
+//
+// Copyright (C) 2018  Jean Pierre Cimalando
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 3.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+
+//
+//  Random.h
+//  Frontières
+//
+//  Random numbers of the audio thread: each cloud owns a generator, so
+//  there is no shared state, no lock, and a seed gives the same render.
+//  xoshiro128+ runs as four interleaved streams, which the batch fill
+//  advances together in SSE2 lanes; single draws are taken from a block
+//  refilled that way.
+//
+
+#ifndef RANDOM_H
+#define RANDOM_H
+
+#include <stdint.h>
+
+// values drawn at once for single draws
+enum { RANDOM_BLOCK = 64 };
+
+class Random {
+
+public:
+    // constructor
+    Random(uint64_t theSeed = 1);
+
+    // restart the sequence
+    void seed(uint64_t theSeed);
+
+    // next value in [0, 1)
+    float uniform()
+    {
+        if (next == RANDOM_BLOCK) {
+            fill(block, RANDOM_BLOCK);
+            next = 0;
+        }
+        return block[next++];
+    }
+
+    // next n values in [0, 1)
+    void fill(float *out, unsigned int n);
+
+private:
+    // state words of the four streams, [word][stream]
+    uint32_t state[4][4];
+
+    // values of the last block, and the next one to hand out
+    float block[RANDOM_BLOCK];
+    unsigned int next;
+};
+
+#endif
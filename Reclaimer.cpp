@@ -0,0 +1,118 @@
+//------------------------------------------------------------------------------
+// FRONTIÈRES:  An interactive granular sampler.
+//------------------------------------------------------------------------------
+// More information is available at
+//     http::/ccrma.stanford.edu/~carlsonc/256a/Borderlands/index.html
+//
+//
+// Copyright (C) 2018  Jean Pierre Cimalando
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 3.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+
+//
+//  Reclaimer.cpp
+//  Frontières
+//
+
+#include "Reclaimer.h"
+#include <chrono>
+
+// how often the background thread looks at the epoch while it waits
+#define RECLAIM_POLL_MS 50
+
+
+//-----------------------------------------------------------------------------
+// Constructor / destructor
+//-----------------------------------------------------------------------------
+Reclaimer::~Reclaimer()
+{
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        quit = true;
+    }
+    wake.notify_one();
+    thread.join();
+
+    reclaim(true);
+}
+
+Reclaimer::Reclaimer()
+    : epoch(0), quit(false)
+{
+    thread = std::thread(&Reclaimer::threadMain, this);
+}
+
+
+//-----------------------------------------------------------------------------
+// Retirement
+//-----------------------------------------------------------------------------
+void Reclaimer::retire(void *object, Deleter deleter)
+{
+    Retired item;
+    item.object = object;
+    item.deleter = deleter;
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        item.epoch = epoch.load();
+        retired.push_back(item);
+    }
+    wake.notify_one();
+}
+
+unsigned int Reclaimer::numRetired()
+{
+    std::lock_guard<std::mutex> guard(lock);
+    return retired.size();
+}
+
+
+//-----------------------------------------------------------------------------
+// Background thread
+//-----------------------------------------------------------------------------
+void Reclaimer::threadMain()
+{
+    std::unique_lock<std::mutex> guard(lock);
+    while (!quit) {
+        // sleep until something is retired, then look again now and then,
+        // as the audio thread does not signal
+        if (retired.empty())
+            wake.wait(guard);
+        else
+            wake.wait_for(guard, std::chrono::milliseconds(RECLAIM_POLL_MS));
+
+        guard.unlock();
+        reclaim(false);
+        guard.lock();
+    }
+}
+
+void Reclaimer::reclaim(bool all)
+{
+    uint64_t now = epoch.load();
+
+    for (;;) {
+        Retired item;
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            // (retired in order, so the epochs only grow)
+            if (retired.empty() || (!all && retired.front().epoch + 2 > now))
+                return;
+            item = retired.front();
+            retired.pop_front();
+        }
+        // delete out of the lock, destructors may take their time
+        item.deleter(item.object);
+    }
+}
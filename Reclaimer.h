@@ -0,0 +1,111 @@
+//------------------------------------------------------------------------------
+// FRONTIÈRES:  An interactive granular sampler.
+//------------------------------------------------------------------------------
+// More information is available at
+//     http::/ccrma.stanford.edu/~carlsonc/256a/Borderlands/index.html
+//
+//
+// Copyright (C) 2018  Jean Pierre Cimalando
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 3.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+
+//
+//  Reclaimer.h
+//  Frontières
+//
+//  Deferred deletion of the objects the audio thread may be reading.  The
+//  audio thread counts its callbacks (an epoch), an object taken out of its
+//  reach is retired with the epoch of that moment, and a background thread
+//  deletes it once two more callbacks have ended: the one which may have
+//  been running, and one which started afterwards and so has let go of the
+//  object.  The audio thread never deletes, waits or locks here.
+//
+
+#ifndef RECLAIMER_H
+#define RECLAIMER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <stdint.h>
+
+class Reclaimer {
+
+public:
+    typedef void (*Deleter)(void *object);
+
+    // destructor (deletes all objects still retired: the audio must have
+    // stopped)
+    ~Reclaimer();
+
+    // constructor (starts the background thread)
+    Reclaimer();
+
+    // audio thread: a callback has ended (sequentially consistent, like the
+    // ring buffer of the commands, so that a callback which starts after an
+    // epoch was read sees what was posted before it was)
+    void advance()
+    {
+        epoch.fetch_add(1);
+    }
+
+    // other threads: delete an object once no callback can see it anymore.
+    // it must be unreachable for the callbacks which start from now on
+    // (for instance, its removal was posted to the audio thread).
+    void retire(void *object, Deleter deleter);
+
+    template <class T>
+    void retire(T *object)
+    {
+        retire(object, &destroy<T>);
+    }
+
+    // number of objects waiting to be deleted
+    unsigned int numRetired();
+
+protected:
+    // wait for retired objects and delete them when it is safe
+    void threadMain();
+
+    // delete the objects safe to delete, or all of them
+    void reclaim(bool all);
+
+    template <class T>
+    static void destroy(void *object)
+    {
+        delete (T *)object;
+    }
+
+private:
+    struct Retired {
+        void *object;
+        Deleter deleter;
+        uint64_t epoch;
+    };
+
+    // callbacks ended so far
+    std::atomic<uint64_t> epoch;
+
+    // objects in order of retirement, shared with the background thread
+    std::mutex lock;
+    std::condition_variable wake;
+    std::deque<Retired> retired;
+    bool quit;
+    std::thread thread;
+};
+
+#endif
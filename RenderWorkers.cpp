@@ -0,0 +1,194 @@
+//------------------------------------------------------------------------------
+// FRONTIÈRES:  An interactive granular sampler.
+//------------------------------------------------------------------------------
+// More information is available at
+//     http::/ccrma.stanford.edu/~carlsonc/256a/Borderlands/index.html
+//
+//
+// Copyright (C) 2018  Jean Pierre Cimalando
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 3.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+
+//
+//  RenderWorkers.cpp
+//  Frontières
+//
+
+#include "RenderWorkers.h"
+
+#if defined(__linux__)
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
+#include <limits.h>
+#endif
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// spins before a worker goes to sleep
+#define RENDER_SPIN_COUNT 2000
+
+
+//-----------------------------------------------------------------------------
+// Waiting
+//-----------------------------------------------------------------------------
+static inline void cpuRelax()
+{
+#if defined(__SSE2__)
+    _mm_pause();
+#endif
+}
+
+static void waitChange(std::atomic<uint32_t> *word, uint32_t value)
+{
+    for (int i = 0; i < RENDER_SPIN_COUNT; i++) {
+        if (word->load(std::memory_order_acquire) != value)
+            return;
+        cpuRelax();
+    }
+    while (word->load(std::memory_order_acquire) == value) {
+#if defined(__linux__)
+        // sleeps only if the word still holds the value
+        syscall(SYS_futex, (uint32_t *)word, FUTEX_WAIT_PRIVATE, value, NULL, NULL, 0);
+#else
+        std::this_thread::yield();
+#endif
+    }
+}
+
+static void wakeAll(std::atomic<uint32_t> *word)
+{
+#if defined(__linux__)
+    syscall(SYS_futex, (uint32_t *)word, FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL, 0);
+#else
+    (void)word;
+#endif
+}
+
+
+//-----------------------------------------------------------------------------
+// Constructor / destructor
+//-----------------------------------------------------------------------------
+RenderWorkers::~RenderWorkers()
+{
+    quit.store(true);
+    generation.fetch_add(1);
+    wakeAll(&generation);
+    for (unsigned int i = 0; i < numThreads; i++)
+        threads[i].join();
+    delete[] threads;
+}
+
+RenderWorkers::RenderWorkers(unsigned int theNumThreads)
+    : generation(0), nextJob(0), jobsLeft(0), quit(false), job(NULL), jobArg(NULL),
+      jobCount(0)
+{
+    if (theNumThreads > RENDER_MAX_THREADS)
+        theNumThreads = RENDER_MAX_THREADS;
+    numThreads = theNumThreads;
+
+    threads = new std::thread[numThreads];
+    for (unsigned int i = 0; i < numThreads; i++)
+        threads[i] = std::thread(&RenderWorkers::workerMain, this, i);
+}
+
+unsigned int RenderWorkers::getNumThreads()
+{
+    return numThreads;
+}
+
+
+//-----------------------------------------------------------------------------
+// Workers
+//-----------------------------------------------------------------------------
+void RenderWorkers::workerMain(unsigned int idx)
+{
+#if defined(__linux__)
+    // one core each, leaving the first to the rest of the system, and a
+    // real-time priority if we are allowed one
+    unsigned int numCpus = std::thread::hardware_concurrency();
+    if (numCpus > 1) {
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        CPU_SET(1 + idx % (numCpus - 1), &cpus);
+        pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+    }
+    sched_param param;
+    param.sched_priority = sched_get_priority_min(SCHED_FIFO) + 1;
+    pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+#else
+    (void)idx;
+#endif
+
+    uint32_t seen = 0;
+    for (;;) {
+        waitChange(&generation, seen);
+        seen = generation.load(std::memory_order_acquire);
+        if (quit.load())
+            break;
+        work(seen);
+    }
+}
+
+void RenderWorkers::work(uint32_t gen)
+{
+    for (;;) {
+        // claim the next job, unless the batch is over or is another one
+        uint64_t tagged = nextJob.load(std::memory_order_acquire);
+        unsigned int count = jobCount.load(std::memory_order_relaxed);
+        if ((uint32_t)(tagged >> 32) != gen || (uint32_t)tagged >= count)
+            return;
+        if (!nextJob.compare_exchange_weak(tagged, tagged + 1, std::memory_order_acq_rel))
+            continue;
+
+        job.load(std::memory_order_relaxed)(jobArg.load(std::memory_order_relaxed),
+                                            (uint32_t)tagged);
+        jobsLeft.fetch_sub(1, std::memory_order_release);
+    }
+}
+
+
+//-----------------------------------------------------------------------------
+// Batches
+//-----------------------------------------------------------------------------
+void RenderWorkers::run(Job theJob, void *arg, unsigned int count)
+{
+    if (count == 0)
+        return;
+
+    if (numThreads == 0 || count == 1) {
+        for (unsigned int i = 0; i < count; i++)
+            theJob(arg, i);
+        return;
+    }
+
+    // publish the batch, then the generation which wakes the workers
+    uint32_t gen = generation.load(std::memory_order_relaxed) + 1;
+    job.store(theJob, std::memory_order_relaxed);
+    jobArg.store(arg, std::memory_order_relaxed);
+    jobCount.store(count, std::memory_order_relaxed);
+    jobsLeft.store(count, std::memory_order_relaxed);
+    nextJob.store((uint64_t)gen << 32, std::memory_order_release);
+    generation.store(gen, std::memory_order_release);
+    wakeAll(&generation);
+
+    // help, then wait for the jobs still running
+    work(gen);
+    while (jobsLeft.load(std::memory_order_acquire) != 0)
+        cpuRelax();
+}
@@ -0,0 +1,87 @@
+//------------------------------------------------------------------------------
+// FRONTIÈRES:  An interactive granular sampler.
+//------------------------------------------------------------------------------
+// More information is available at
+//     http::/ccrma.stanford.edu/~carlsonc/256a/Borderlands/index.html
+//
+//
+// Copyright (C) 2018  Jean Pierre Cimalando
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 3.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+
+//
+//  RenderWorkers.h
+//  Frontières
+//
+//  Threads which help the audio callback render the clouds.  A batch of
+//  jobs is published with a generation number, the workers sleep on it
+//  (a futex on Linux, a yield loop elsewhere), claim the jobs with an
+//  atomic counter tagged with the generation, and the caller takes jobs
+//  too until none is left.  Nothing here locks or allocates after the
+//  constructor.
+//
+
+#ifndef RENDERWORKERS_H
+#define RENDERWORKERS_H
+
+#include <atomic>
+#include <thread>
+#include <stdint.h>
+
+// most helper threads
+enum { RENDER_MAX_THREADS = 32 };
+
+class RenderWorkers {
+
+public:
+    // a job of the batch, given its index
+    typedef void (*Job)(void *arg, unsigned int index);
+
+    // destructor (joins the threads)
+    ~RenderWorkers();
+
+    // constructor, with the number of helper threads (0 renders everything
+    // in the caller)
+    RenderWorkers(unsigned int numThreads);
+
+    unsigned int getNumThreads();
+
+    // run job(arg, i) for i in [0, count), return once all are done
+    void run(Job job, void *arg, unsigned int count);
+
+protected:
+    // wait for the next batch, then work on it, until quit
+    void workerMain(unsigned int idx);
+
+    // claim and run jobs of a generation until there are none left
+    void work(uint32_t gen);
+
+private:
+    unsigned int numThreads;
+    std::thread *threads;
+
+    // the batch: generation (also the word the workers sleep on), next job
+    // index tagged with the generation in the upper half, and jobs not done
+    std::atomic<uint32_t> generation;
+    std::atomic<uint64_t> nextJob;
+    std::atomic<unsigned int> jobsLeft;
+    std::atomic<bool> quit;
+
+    std::atomic<Job> job;
+    std::atomic<void *> jobArg;
+    std::atomic<unsigned int> jobCount;
+};
+
+#endif
@@ -0,0 +1,102 @@
+//------------------------------------------------------------------------------
+// FRONTIÈRES:  An interactive granular sampler.
+//------------------------------------------------------------------------------
+// More information is available at
+//     http::/ccrma.stanford.edu/~carlsonc/256a/Borderlands/index.html
+//
+//
+// Copyright (C) 2018  Jean Pierre Cimalando
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 3.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+
+//
+//  Scene.cpp
+//  Frontières
+//
+
+#include "Scene.h"
+#include "SoundRect.h"
+#include "Reclaimer.h"
+
+// grains reported between two frames of the GUI
+#define SCENE_MAX_TRIGGERS 4096
+
+
+//-----------------------------------------------------------------------------
+// Geometry
+//-----------------------------------------------------------------------------
+static void deleteGeometry(void *object)
+{
+    SceneGeometry *geometry = (SceneGeometry *)object;
+    delete[] geometry->rects;
+    delete geometry;
+}
+
+
+//-----------------------------------------------------------------------------
+// Constructor / destructor
+//-----------------------------------------------------------------------------
+Scene::~Scene()
+{
+    const SceneGeometry *geometry = current.load();
+    if (geometry)
+        deleteGeometry((void *)geometry);
+    delete triggers;
+}
+
+Scene::Scene(Reclaimer *theReclaimer)
+    : current(NULL), reclaimer(theReclaimer)
+{
+    triggers = new Ring_Buffer(SCENE_MAX_TRIGGERS * sizeof(GrainTrigger));
+
+    // no rectangles until the first publish
+    SceneGeometry *geometry = new SceneGeometry;
+    geometry->numRects = 0;
+    geometry->rects = NULL;
+    current.store(geometry);
+}
+
+
+//-----------------------------------------------------------------------------
+// Publication
+//-----------------------------------------------------------------------------
+void Scene::publish(const std::vector<SoundRect *> &rects)
+{
+    SceneGeometry *geometry = new SceneGeometry;
+    geometry->numRects = rects.size();
+    geometry->rects = new RectGeometry[rects.size()];
+    for (unsigned int i = 0; i < rects.size(); i++)
+        geometry->rects[i] = rects[i]->getGeometry();
+
+    // the callbacks which start from now on see the new one, the old one
+    // goes once they are all past it
+    const SceneGeometry *old = current.exchange(geometry);
+    reclaimer->retire((void *)old, &deleteGeometry);
+}
+
+
+//-----------------------------------------------------------------------------
+// Grains for display
+//-----------------------------------------------------------------------------
+void Scene::postTrigger(const GrainTrigger &trigger)
+{
+    if (triggers->size_free() >= sizeof(GrainTrigger))
+        triggers->put(trigger);
+}
+
+bool Scene::nextTrigger(GrainTrigger *trigger)
+{
+    return triggers->get(*trigger);
+}
@@ -0,0 +1,112 @@
+//------------------------------------------------------------------------------
+// FRONTIÈRES:  An interactive granular sampler.
+//------------------------------------------------------------------------------
+// More information is available at
+//     http::/ccrma.stanford.edu/~carlsonc/256a/Borderlands/index.html
+//
+//
+// Copyright (C) 2018  Jean Pierre Cimalando
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 3.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+
+//
+//  Scene.h
+//  Frontières
+//
+//  What the audio thread knows of the landscape.  The GUI publishes an
+//  immutable copy of the geometry of the sound rectangles whenever it
+//  changes (the clouds carry their own position, see ClusterParams), and
+//  the audio thread triggers grains from the copy it finds at the start of
+//  a callback, never touching the objects of the GUI.  Where the grains
+//  went comes back to the GUI, for display, through a ring buffer.
+//
+
+#ifndef SCENE_H
+#define SCENE_H
+
+#include <ring_buffer.h>
+#include <atomic>
+#include <vector>
+
+class SoundRect;
+class Reclaimer;
+
+// a sound rectangle
+struct RectGeometry {
+    float left, right, bottom, top;
+    float width, height;
+    // playback position along x (else along y, the other axis is volume)
+    bool sideways;
+
+    // relative position of (x, y) in the rect and volume there, if inside
+    bool locate(float x, float y, double *position, double *volume) const
+    {
+        if (!(x > left && x < right && y > bottom && y < top))
+            return false;
+        double u = (double)((x - left) / width);
+        double v = (double)((y - bottom) / height);
+        *position = sideways ? u : v;
+        *volume = sideways ? v : u;
+        return true;
+    }
+};
+
+// the rectangles, rectangle i playing sound i
+struct SceneGeometry {
+    unsigned int numRects;
+    RectGeometry *rects;
+};
+
+// a grain as the audio thread triggered it, for display
+struct GrainTrigger {
+    unsigned int cloudId;
+    unsigned int grain;
+    float x, y;
+    float duration;  // ms
+    bool sounds;  // over some rectangle
+};
+
+class Scene {
+
+public:
+    // destructor
+    ~Scene();
+
+    // constructor, with the reclaimer of the old geometry
+    Scene(Reclaimer *reclaimer);
+
+    // GUI thread: copy the geometry of the rectangles for the audio thread
+    void publish(const std::vector<SoundRect *> &rects);
+
+    // audio thread: the latest geometry (it stays valid until the callback
+    // ends; sequentially consistent, as the Reclaimer relies on it)
+    const SceneGeometry *geometry()
+    {
+        return current.load();
+    }
+
+    // audio thread: report a grain (dropped if the GUI lags behind)
+    void postTrigger(const GrainTrigger &trigger);
+
+    // GUI thread: the next grain to display, false if there is none
+    bool nextTrigger(GrainTrigger *trigger);
+
+private:
+    std::atomic<const SceneGeometry *> current;
+    Reclaimer *reclaimer;
+    Ring_Buffer *triggers;
+};
+
+#endif
@@ -313,12 +313,12 @@ void SoundRect::setUps()
 //    lastY = (float)y;
 //}
 
-void SoundRect::associateSound(double *theBuff, unsigned long buffFrames, unsigned int buffChans)
+void SoundRect::associateSound(const AudioFile *theSound)
 {
 
-    myBuff = theBuff;
-    myBuffFrames = buffFrames;
-    myBuffChans = buffChans;
+    myBuff = theSound;
+    myBuffFrames = theSound->frames;
+    myBuffChans = theSound->channels;
     //    if (orientation == true)
     //        setWidthHeight((float)buffFrames/20000.f,rHeight);
     //    else
@@ -409,7 +409,7 @@ void SoundRect::draw()
                     float nextI = (float)i / ups;
 
                     glVertex3f((rleft + nextI),
-                               rY + 0.5f * rHeight * (myBuff[(int)floor(i * myBuffInc)]),
+                               rY + 0.5f * rHeight * (myBuff->sampleAt((unsigned long)floor(i * myBuffInc), 0)),
                                0.0f);
                 }
             }
@@ -417,7 +417,7 @@ void SoundRect::draw()
                 for (int i = 0; i < rHeight * ups; i++) {
                     float nextI = (float)i / ups;
 
-                    glVertex3f(rX + 0.5f * rWidth * (myBuff[(int)floor(i * myBuffInc)]),
+                    glVertex3f(rX + 0.5f * rWidth * (myBuff->sampleAt((unsigned long)floor(i * myBuffInc), 0)),
                                (rbot + nextI), 0.0f);
                 }
             }
@@ -432,7 +432,7 @@ void SoundRect::draw()
                     // glVertex3f((rleft + nextI),rY + rHeight*(0.24f * myBuff[2*(int)floor(i*myBuffInc)]*buffMult+0.1f),0.0f);
                     glVertex3f((rleft + nextI),
                                rY + 0.25 * rHeight +
-                                   0.25f * rHeight * (myBuff[2 * (int)floor(i * myBuffInc)]),
+                                   0.25f * rHeight * (myBuff->sampleAt((unsigned long)floor(i * myBuffInc), 0)),
                                0.0f);
                 }
 
@@ -447,7 +447,7 @@ void SoundRect::draw()
                     glVertex3f((rleft + nextI),
                                rY - 0.25 * rHeight +
                                    0.25f * rHeight *
-                                       (myBuff[2 * (int)floor(i * myBuffInc) + 1]),
+                                       (myBuff->sampleAt((unsigned long)floor(i * myBuffInc), 1)),
                                0.0f);
                 }
                 glEnd();
@@ -459,7 +459,7 @@ void SoundRect::draw()
 
                     // glVertex3f(rX + rWidth*(0.24f * myBuff[2*(int)floor(i*myBuffInc)]*buffMult+0.1f),(rbot + nextI),0.0f);
                     glVertex3f(rX + 0.25 * rWidth +
-                                   0.25f * rWidth * (myBuff[2 * (int)floor(i * myBuffInc)]),
+                                   0.25f * rWidth * (myBuff->sampleAt((unsigned long)floor(i * myBuffInc), 0)),
                                (rbot + nextI), 0.0f);
                 }
 
@@ -474,7 +474,7 @@ void SoundRect::draw()
                     //   glVertex3f(rX + rWidth*(0.24f * myBuff[2*(int)floor(i*myBuffInc)+1]-0.1f),(rbot + nextI),0.0f);
                     glVertex3f(rX - 0.25 * rWidth +
                                    0.25f * rWidth *
-                                       (myBuff[2 * (int)floor(i * myBuffInc) + 1]),
+                                       (myBuff->sampleAt((unsigned long)floor(i * myBuffInc), 1)),
                                (rbot + nextI), 0.0f);
                 }
                 glEnd();
@@ -512,29 +512,18 @@ bool SoundRect::insideMe(float x, float y)
     return false;
 }
 
-// return normalized position values in x and y
-bool SoundRect::getNormedPosition(double *positionsX, double *positionsY,
-                                  float x, float y, unsigned int idx)
+// corners and orientation, as the audio thread sees them
+RectGeometry SoundRect::getGeometry()
 {
-    bool trigger = false;
-    // cout << "grainX:  " << x << " grainY: " << y << " rleft " << rleft << " rright" << rright << " rtop " << rtop << " rbottom " << rbot <<  endl;
-    if (insideMe(x, y) == true) {
-        trigger = true;
-        if (orientation == true) {
-            positionsX[idx] = (double)((x - rleft) / rWidth);
-            positionsY[idx] = (double)((y - rbot) / rHeight);
-        }
-        else {
-            positionsY[idx] = (double)((x - rleft) / rWidth);
-            positionsX[idx] = (double)((y - rbot) / rHeight);
-        }
-        // cout << positionsX[idx] << ", " << positionsY[idx]<<endl;
-        if ((positionsY[idx] < 0.0) || (positionsY[idx] > 1.0))
-            cout << "problem with x trigger pos - see soundrect get normed pos" << endl;
-        if ((positionsY[idx] < 0.0) || (positionsY[idx] > 1.0))
-            cout << "problem with x trigger pos - see soundrect get normed pos" << endl;
-    }
-    return trigger;
+    RectGeometry geometry;
+    geometry.left = rleft;
+    geometry.right = rright;
+    geometry.bottom = rbot;
+    geometry.top = rtop;
+    geometry.width = rWidth;
+    geometry.height = rHeight;
+    geometry.sideways = orientation;
+    return geometry;
 }
 
 
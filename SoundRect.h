@@ -32,6 +32,8 @@
 #define SOUNDRECT_H
 
 #include "theglobals.h"
+#include "AudioFileSet.h"
+#include "Scene.h"
 //#include "pt2d.h"
 // graphics includes
 #ifdef __MACOSX_CORE__
@@ -85,13 +87,12 @@ public:
     bool select(float x, float y);
 
     void toggleWaveDisplay();
-    void associateSound(double *theBuff, unsigned long buffFrames, unsigned int buffChans);
+    void associateSound(const AudioFile *theSound);
     // return id
     // unsigned int getId();
 
-    // return
-    bool getNormedPosition(double *positionsX, double *positionsY, float x,
-                           float y, unsigned int idx);
+    // corners and orientation, for the audio thread (see Scene)
+    RectGeometry getGeometry();
 
     // change from vertical to horizontal
     void toggleOrientation();
@@ -118,7 +119,7 @@ private:
     bool isSelected;
     float colR, colG, colB, colA;
     float minDim;
-    double *myBuff;
+    const AudioFile *myBuff;
     double startTime;
     float ups;
     unsigned long myBuffFrames;
@@ -0,0 +1,89 @@
+//------------------------------------------------------------------------------
+// FRONTIÈRES:  An interactive granular sampler.
+//------------------------------------------------------------------------------
+// More information is available at
+//     http::/ccrma.stanford.edu/~carlsonc/256a/Borderlands/index.html
+//
+//
+// Copyright (C) 2018  Jean Pierre Cimalando
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 3.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+
+//
+//  TripleBuffer.h
+//  Frontières
+//
+//  A value written by one thread and read by another, without locks and
+//  without tearing.  The writer fills a slot of its own and publishes it,
+//  the reader takes the latest published slot when it wants to; the third
+//  slot is the one in between.
+//
+
+#ifndef TRIPLEBUFFER_H
+#define TRIPLEBUFFER_H
+
+#include <atomic>
+
+template <class T>
+class TripleBuffer {
+
+public:
+    // constructor (all slots value-initialized)
+    TripleBuffer()
+        : slots(), middle(1), back(0), front(2)
+    {
+    }
+
+    // writer: the slot to fill (not the last value written, keep a copy)
+    T &write()
+    {
+        return slots[back];
+    }
+
+    // writer: make the slot written the latest value
+    void publish()
+    {
+        unsigned int old = middle.exchange(back | NEW_VALUE, std::memory_order_acq_rel);
+        back = old & SLOT_MASK;
+    }
+
+    // reader: take the latest value if there is a new one, returns whether
+    // there was
+    bool update()
+    {
+        if ((middle.load(std::memory_order_relaxed) & NEW_VALUE) == 0)
+            return false;
+        unsigned int old = middle.exchange(front, std::memory_order_acq_rel);
+        front = old & SLOT_MASK;
+        return true;
+    }
+
+    // reader: the value taken
+    const T &read() const
+    {
+        return slots[front];
+    }
+
+private:
+    enum { SLOT_MASK = 3, NEW_VALUE = 4 };
+
+    T slots[3];
+    // slot in between, with NEW_VALUE if it was published since the last
+    // update; slots of the writer and of the reader
+    std::atomic<unsigned int> middle;
+    unsigned int back, front;
+};
+
+#endif
@@ -28,107 +28,222 @@
 //
 
 #include "Window.h"
+#include "Reclaimer.h"
 
 
 // destructor
 Window::~Window()
 {
-    delete[] hanningWin;
-    delete[] triWin;
-    // delete [] trapWin;
-    delete[] sincWin;
-    delete[] rexpDecWin;
-    delete[] expDecWin;
+    for (unsigned int i = 0; i < numTables; i++)
+        delete[] tables[i].storage;
 }
 
 
 // constructor
-Window::Window(unsigned long length)
+Window::Window()
+    : numTables(0), numSerials(0), reclaimer(NULL)
 {
-    hanningWin = new double[length];
-    triWin = new double[length];
-    // trapWin = new double[length];
-    expDecWin = new double[length];
-    rexpDecWin = new double[length];
-    sincWin = new double[length];
-
-    // create
-    generateWindows(length);
+    // the default window is always there (used for good), as a fallback
+    // when the table space runs out
+    getWindow(HANNING);
 }
 
 
 int Window::numWindows()
 {
-    return 6;
+    return RANDOM_WIN + 1;
 }
 
 Window &Window::Instance()
 {
     static Window *theWindow = NULL;
     if (theWindow == NULL)
-        theWindow = new Window(WINDOW_LEN);
+        theWindow = new Window();
 
     return *theWindow;
 }
 
-//
-////resize windows
-// void Window::resizeWindows(unsigned long length){
-//
-//    if (hanningWin != NULL){
-//        delete [] hanningWin;
-//        hanningWin = new double[length];
-//    }
-//
-//    if (triWin != NULL){
-//        delete [] triWin;
-//        triWin = new double[length];
-//    }
-//
-//
-//    if (trapWin != NULL){
-//        delete [] trapWin;
-//        trapWin = new double[length];
-//
-//
-//    }
-//    if (sincWin != NULL){
-//        delete [] sincWin;
-//        sincWin = new double[length];
-//
-//    }
-//
-//    if (rexpDecWin != NULL){
-//        delete [] rexpDecWin;
-//        rexpDecWin = new double[length];
-//
-//    }
-//    if (expDecWin != NULL){
-//        delete [] expDecWin;
-//        expDecWin = new double[length];
-//    }
-//
-//
-//
-//}
 
-// create all windows
-void Window::generateWindows(unsigned long length)
+//-------------------------------------------------------------------------------
+// shape parameters
+//-------------------------------------------------------------------------------
+bool Window::hasParam(unsigned int windowType)
+{
+    return windowType == TUKEY || windowType == GAUSSIAN || windowType == TRAPEZOID;
+}
+
+double Window::defaultParam(unsigned int windowType)
+{
+    switch (windowType) {
+    case TUKEY:
+        return 0.5;
+    case GAUSSIAN:
+        return 0.15;
+    case TRAPEZOID:
+        return 0.2;
+    default:
+        return 0.0;
+    }
+}
+
+double Window::fitParam(unsigned int windowType, double param)
 {
-    // clear all windows
-    for (int i = 0; i < length; i++) {
-        hanningWin[i] = (double)0.0;
-        triWin[i] = (double)0.0;
-        // trapWin[i] = (double)0.0;
-        sincWin[i] = (double)0.0;
-        expDecWin[i] = (double)0.0;
-        rexpDecWin[i] = (double)0.0;
+    if (!hasParam(windowType))
+        return 0.0;
+    if (param < 0.0)
+        return defaultParam(windowType);
+
+    double lo = 0.0, hi = 1.0;
+    if (windowType == GAUSSIAN) {
+        lo = 0.02;
+        hi = 0.5;
+    }
+    param = (param < lo) ? lo : ((param > hi) ? hi : param);
+    // hundredths, so that a parameter sweep makes a bounded number of tables
+    return floor(param * 100.0 + 0.5) / 100.0;
+}
+
+unsigned int Window::fitLength(unsigned int length)
+{
+    unsigned int fit = WINDOW_MIN_LEN;
+    while (fit < length && fit < WINDOW_MAX_LEN)
+        fit *= 2;
+    return fit;
+}
+
+
+//-------------------------------------------------------------------------------
+// table cache
+//-------------------------------------------------------------------------------
+WindowTable *Window::findWindow(unsigned int windowType, double param,
+                                unsigned int length)
+{
+    for (unsigned int i = 0; i < numTables; i++) {
+        WindowTable *table = &tables[i];
+        if (table->type == windowType && table->param == param &&
+            table->length == length)
+            return table;
+    }
+    return NULL;
+}
+
+WindowTable *Window::freeSlot()
+{
+    if (numTables < WINDOW_MAX_TABLES) {
+        WindowTable *table = &tables[numTables++];
+        table->users = 0;
+        table->retiring = 0;
+        table->grains = 0;
+        return table;
+    }
+    for (unsigned int i = 0; i < numTables; i++) {
+        WindowTable *table = &tables[i];
+        if (table->users == 0 && table->retiring == 0 && table->grains == 0) {
+            delete[] table->storage;
+            return table;
+        }
+    }
+    return NULL;
+}
+
+// return pointer to required window
+const WindowTable *Window::getWindow(unsigned int windowType, double param,
+                                     unsigned int length)
+{
+    if (windowType >= RANDOM_WIN)
+        windowType = HANNING;
+    param = fitParam(windowType, param);
+    length = fitLength(length);
+
+    tableLock.lock();
+    WindowTable *table = findWindow(windowType, param, length);
+    if (!table) {
+        table = freeSlot();
+        if (table) {
+            table->type = windowType;
+            table->param = param;
+            table->length = length;
+            table->serial = ++numSerials;
+            generateWindow(table);
+        }
+    }
+    if (table)
+        table->users++;
+    tableLock.unlock();
+
+    return table;
+}
+
+void Window::releaseWindow(const WindowTable *table)
+{
+    tableLock.lock();
+    WindowTable *t = &tables[table - tables];
+    // the cloud published parameters without it: the callbacks which start
+    // from now on only see it in the grains they play.  without a
+    // reclaimer, it is never past them.
+    if (--t->users == 0) {
+        t->retiring++;
+        if (reclaimer)
+            reclaimer->retire(t, &Window::retired);
+    }
+    tableLock.unlock();
+}
+
+void Window::retired(void *table)
+{
+    Window &windows = Instance();
+    windows.tableLock.lock();
+    ((WindowTable *)table)->retiring--;
+    windows.tableLock.unlock();
+}
+
+void Window::setReclaimer(Reclaimer *theReclaimer)
+{
+    tableLock.lock();
+    reclaimer = theReclaimer;
+    tableLock.unlock();
+}
+
+// create one window
+void Window::generateWindow(WindowTable *table)
+{
+    unsigned long length = table->length;
+
+    // 64-byte aligned, zeroed (the guard point included)
+    const unsigned int align = 64 / sizeof(float);
+    table->storage = new float[length + 1 + align]();
+    table->data = table->storage + (align - ((uintptr_t)table->storage / sizeof(float)) % align) % align;
+
+    float *window = table->data;
+    switch (table->type) {
+    case HANNING:
+        hanning(window, length);
+        break;
+    case TRIANGLE:
+        triangle(window, length);
+        break;
+    case EXPDEC:
+        expdec(window, length, false);
+        break;
+    case REXPDEC:
+        expdec(window, length, true);
+        break;
+    case SINC:
+        sinc(window, length, 8);
+        break;
+    case TUKEY:
+        tukey(window, length, table->param);
+        break;
+    case GAUSSIAN:
+        gaussian(window, length, table->param);
+        break;
+    case BLACKMAN_HARRIS:
+        blackmanHarris(window, length);
+        break;
+    case TRAPEZOID:
+        trapezoid(window, length, table->param);
+        break;
     }
-    hanning(hanningWin, length);
-    triangle(triWin, length);
-    // trapezoid(trapWin, length);
-    sinc(sincWin, length, 8);
-    expdec(expDecWin, rexpDecWin, length);
 }
 
 
@@ -137,66 +252,54 @@ void Window::generateWindows(unsigned long length)
 //-------------------------------------------------------------------------------
 // hanning / raised cosine window
 //-------------------------------------------------------------------------------
-void Window::hanning(double *window, unsigned long length)
+void Window::hanning(float *window, unsigned long length)
 {
     assert(length > 0);
     unsigned long i;
-    double pi, phase = 0, delta;
+    double phase = 0, delta;
 
     delta = 2 * PI / (double)length;
 
     for (i = 0; i < length; i++) {
-        window[i] = (double)(0.5 * (1.0 - cos(phase)));
+        window[i] = (float)(0.5 * (1.0 - cos(phase)));
         phase += delta;
     }
 }
 
 
-//-------------------------------------------------------------------------------
-//
-//-------------------------------------------------------------------------------
-// void Window::trapezoid( double * window, unsigned long length )
-//{
-//    assert(length > 0);
-//
-//}
-
-
 //-------------------------------------------------------------------------------
 // triangle window
 //-------------------------------------------------------------------------------
-void Window::triangle(double *window, unsigned long length)
+void Window::triangle(float *window, unsigned long length)
 {
     assert(length > 0);
 
     double norm = (2.0 / ((double)length - 1));
     double invnorm = 1.0 / norm;
 
-    for (int i = 0; i < length; i++) {
-        window[i] = norm * (invnorm - fabs(i - invnorm));
+    for (unsigned long i = 0; i < length; i++) {
+        window[i] = (float)(norm * (invnorm - fabs(i - invnorm)));
     }
 }
 
 
 //-------------------------------------------------------------------------------
-//
+// decaying exponential (forward or reverse)
 //-------------------------------------------------------------------------------
-void Window::expdec(double *forWin, double *revWin, unsigned long length)
+void Window::expdec(float *window, unsigned long length, bool reverse)
 {
     assert(length > 0);
 
-    // create decaying exponential (forward and reverse)
-
     // exp time constant (in samples)
-    double tau = 512.0;
+    double tau = length * WINDOW_EXP_TAU;
     double tauInv = 1.0 / tau;
-    double eps = 0.0005;
-    unsigned long transition = length - 48;
 
-    for (int i = 0; i < length; i++) {
-        forWin[i] = exp(-((double)i) * tauInv);
-        if (revWin)
-            revWin[length - i - 1] = forWin[i];
+    for (unsigned long i = 0; i < length; i++) {
+        float value = (float)exp(-((double)i) * tauInv);
+        if (reverse)
+            window[length - i - 1] = value;
+        else
+            window[i] = value;
     }
 }
 
@@ -204,20 +307,19 @@ void Window::expdec(double *forWin, double *revWin, unsigned long length)
 //-------------------------------------------------------------------------------
 // SINC window with flexible number of zero crossings
 //-------------------------------------------------------------------------------
-void Window::sinc(double *window, unsigned long length, int numZeroCross)
+void Window::sinc(float *window, unsigned long length, int numZeroCross)
 {
     // note - numZeroCross should be even number, otherwise window will shift.
     // note also - numZeroCross = 1 is Lanczos window - main lobe
     double inc = numZeroCross / (double)length;
     double x = -(numZeroCross) / 2.0;
-    // std::cout << numZeroCross << endl;
 
-    for (int i = 0; i < length; i++) {
+    for (unsigned long i = 0; i < length; i++) {
         if (x != 0) {
-            sincWin[i] = fabs(sin(PI * x) / (PI * x));
+            window[i] = (float)fabs(sin(PI * x) / (PI * x));
         }
         else {
-            sincWin[i] = (double)1.0;
+            window[i] = 1.0f;
         }
 
         x += inc;
@@ -225,31 +327,66 @@ void Window::sinc(double *window, unsigned long length, int numZeroCross)
 }
 
 
-// return pointer to required window
-double *Window::getWindow(unsigned int windowType)
+//-------------------------------------------------------------------------------
+// tukey / tapered cosine window: flat top, cosine tapers over the ratio
+//-------------------------------------------------------------------------------
+void Window::tukey(float *window, unsigned long length, double ratio)
 {
-    switch (windowType) {
-    case HANNING:
-        return hanningWin;
-        break;
-    case TRIANGLE:
-        // cout << "triangle-selected"<<endl;
-        return triWin;
-        break;
-        //        case TRAPEZOID:
-        //            return trapWin;
-        //            break;
-    case EXPDEC:
-        return expDecWin;
-        break;
-    case REXPDEC:
-        return rexpDecWin;
-        break;
-    case SINC:
-        return sincWin;
-        break;
-    default:
-        return hanningWin;
-        break;
+    assert(length > 1);
+
+    for (unsigned long i = 0; i < length; i++) {
+        double x = (double)i / (length - 1);
+        double edge = (x < 0.5) ? x : 1.0 - x;
+        if (2.0 * edge >= ratio)
+            window[i] = 1.0f;
+        else
+            window[i] = (float)(0.5 * (1.0 - cos(2 * PI * edge / ratio)));
+    }
+}
+
+
+//-------------------------------------------------------------------------------
+// gaussian window, sigma relative to the length
+//-------------------------------------------------------------------------------
+void Window::gaussian(float *window, unsigned long length, double sigma)
+{
+    assert(length > 1);
+
+    for (unsigned long i = 0; i < length; i++) {
+        double x = ((double)i / (length - 1) - 0.5) / sigma;
+        window[i] = (float)exp(-0.5 * x * x);
+    }
+}
+
+
+//-------------------------------------------------------------------------------
+// 4-term blackman-harris window
+//-------------------------------------------------------------------------------
+void Window::blackmanHarris(float *window, unsigned long length)
+{
+    assert(length > 1);
+
+    for (unsigned long i = 0; i < length; i++) {
+        double phase = 2 * PI * i / (length - 1);
+        window[i] = (float)(0.35875 - 0.48829 * cos(phase) + 0.14128 * cos(2 * phase) -
+                            0.01168 * cos(3 * phase));
+    }
+}
+
+
+//-------------------------------------------------------------------------------
+// trapezoid window: flat top, linear ramps over the ratio
+//-------------------------------------------------------------------------------
+void Window::trapezoid(float *window, unsigned long length, double ratio)
+{
+    assert(length > 1);
+
+    for (unsigned long i = 0; i < length; i++) {
+        double x = (double)i / (length - 1);
+        double edge = (x < 0.5) ? x : 1.0 - x;
+        if (2.0 * edge >= ratio)
+            window[i] = 1.0f;
+        else
+            window[i] = (float)(2.0 * edge / ratio);
     }
 }
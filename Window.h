@@ -37,44 +37,115 @@
 #include "assert.h"
 #include "theglobals.h"
 #include <iostream>
+#include <atomic>
 #include <Stk.h>
+#include "Thread.h"
 
 using namespace std;
 
-enum { HANNING, TRIANGLE, EXPDEC, REXPDEC, SINC, RANDOM_WIN };
+class Reclaimer;
+
+enum {
+    HANNING,
+    TRIANGLE,
+    EXPDEC,
+    REXPDEC,
+    SINC,
+    TUKEY,            // parameter: ratio of the cosine tapers
+    GAUSSIAN,         // parameter: standard deviation, relative to the length
+    BLACKMAN_HARRIS,
+    TRAPEZOID,        // parameter: ratio of the linear ramps
+    RANDOM_WIN
+};
+
+// shortest and longest window tables
+enum { WINDOW_MIN_LEN = 64, WINDOW_MAX_LEN = 16384 };
+// most window tables in use at once
+enum { WINDOW_MAX_TABLES = 256 };
+// time constant of the exponential windows, relative to their length
+#define WINDOW_EXP_TAU 0.25
+
+// generated table of one window shape
+struct WindowTable {
+    unsigned int type;
+    double param;
+    // number of points, plus one guard point past the end for interpolated
+    // reads of the last index
+    unsigned int length;
+    // number of the table, never given twice (unlike its slot)
+    unsigned long serial;
+    // first point, aligned on a cache line inside of storage
+    float *data;
+    float *storage;
+    // users from getWindow, retirements the audio thread may not be past,
+    // and grains playing the table (counted by the voice pool)
+    unsigned int users;
+    unsigned int retiring;
+    mutable std::atomic<unsigned int> grains;
+};
 
 class Window {
 public:
     static Window &Instance();
 
 
-    // return window
-    double *getWindow(unsigned int windowType);
-    // resize windows - future possibility, but probably not needed
-    // void resizeWindows(unsigned long length);
+    // return the window of a shape, generating it if needed, and count the
+    // caller as a user until releaseWindow.  a negative parameter stands
+    // for the default of the shape, and the length is rounded up to a power
+    // of two.  returns NULL if the window is new and WINDOW_MAX_TABLES are
+    // in use.
+    const WindowTable *getWindow(unsigned int windowType, double param = -1.0,
+                                 unsigned int length = WINDOW_LEN);
+    // let go of a window.  its slot may take another window once it has no
+    // users, the audio thread can't see it in the parameters of a cloud
+    // anymore, and no grain plays it.
+    void releaseWindow(const WindowTable *table);
+
+    // reclaimer telling when the audio thread is past a window (without
+    // one, the windows let go of are kept)
+    void setReclaimer(Reclaimer *theReclaimer);
+
+    // whether a shape has a parameter, and its default value
+    static bool hasParam(unsigned int windowType);
+    static double defaultParam(unsigned int windowType);
 
     int numWindows();
 
 protected:
-    // generate windows
-    void generateWindows(unsigned long length);
+    // fit the parameter and the length in their range
+    static double fitParam(unsigned int windowType, double param);
+    static unsigned int fitLength(unsigned int length);
+    // return an already generated window, or NULL
+    WindowTable *findWindow(unsigned int windowType, double param,
+                            unsigned int length);
+    // slot for a new window, a free one or one of a window nobody uses
+    // anymore, or NULL
+    WindowTable *freeSlot();
+    // end of a retirement, from the reclaimer
+    static void retired(void *table);
+    // generate the points of a window
+    void generateWindow(WindowTable *table);
     // window function prototypes
-    void hanning(double *window, unsigned long length);
-    // void trapezoid( double * window, unsigned long length );
-    void triangle(double *window, unsigned long length);
-    void expdec(double *forWin, double *revWin, unsigned long length);
-    void sinc(double *window, unsigned long length, int numZeroCross = 6);
+    void hanning(float *window, unsigned long length);
+    void triangle(float *window, unsigned long length);
+    void expdec(float *window, unsigned long length, bool reverse);
+    void sinc(float *window, unsigned long length, int numZeroCross = 6);
+    void tukey(float *window, unsigned long length, double ratio);
+    void gaussian(float *window, unsigned long length, double sigma);
+    void blackmanHarris(float *window, unsigned long length);
+    void trapezoid(float *window, unsigned long length, double ratio);
 
 
 private:
     ~Window();
-    Window(unsigned long length = 2048);
-    double *hanningWin;
-    // double * trapWin;
-    double *triWin;
-    double *expDecWin;
-    double *rexpDecWin;
-    double *sincWin;
+    Window();
+    // the first numTables slots hold a table.  the audio thread only reads
+    // the tables it was handed, the slots are managed under the lock.
+    WindowTable tables[WINDOW_MAX_TABLES];
+    unsigned int numTables;
+    unsigned long numSerials;
+    Mutex tableLock;
+    Reclaimer *reclaimer;
 };
 
 
@@ -50,7 +50,8 @@
 // graphics picking
 #define NAMEINCREMENT 100
 
-// function to produce a random float
+// function to produce a random float (libc state, keep it out of the audio
+// thread: see Random.h)
 #define randf() ((float)rand() / RAND_MAX)
 
 #define randd() ((double)rand() / RAND_MAX)